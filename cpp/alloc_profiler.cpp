@@ -0,0 +1,93 @@
+#define ALLOC_PROFILER_IMPLEMENTATION
+#include "alloc_profiler.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct alignas(64) CacheLine
+{
+    char data[64];
+};
+
+int main()
+{
+    {
+        alloc_profiler::scope outer{"outer"};
+        auto s = std::make_unique<std::string>(100, 'x');  // the string object, and its buffer
+        {
+            alloc_profiler::scope inner{"inner"};
+            std::vector<int> v(10);
+            auto line = std::make_unique<CacheLine>();      // over-aligned `new`
+            assert(reinterpret_cast<uintptr_t>(line.get()) % 64 == 0);
+            assert(inner.allocations() == 2 && inner.frees() == 0);
+            assert(inner.bytes_allocated() == 10 * sizeof(int) + sizeof(CacheLine));
+        }
+        assert(outer.allocations() == 4 && outer.frees() == 2);
+
+        // nothing here
+        alloc_profiler::scope none{"none"};
+        s->assign(50, 'y');
+        assert(none.allocations() == 0);
+    }
+
+    // other threads are only counted globally (and by their own scopes)
+    auto before = alloc_profiler::global();
+    alloc_profiler::reset_peak();
+    {
+        alloc_profiler::scope main_thread;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([] {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    alloc_profiler::scope worker{"worker"};
+                    std::vector<char> v(1000);
+                    assert(worker.allocations() == 1 && worker.bytes_allocated() == 1000);
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        // `std::thread` allocates its state, but that's it
+        assert(main_thread.allocations() <= 2 * threads.size() + 1);
+    }
+    auto after = alloc_profiler::global();
+    assert(after.total.allocations - before.total.allocations >= 4000);
+    assert(after.total.live_bytes() == before.total.live_bytes());
+    assert(after.peak_live_bytes >= before.total.live_bytes() + 1000);
+
+    size_t worker_scopes = 0;
+    alloc_profiler::for_each_scope([&](const alloc_profiler::scope_totals& s) {
+        if (std::string_view{s.name} == "worker")
+        {
+            worker_scopes = s.entered;
+            assert(s.total.allocations == 4000 && s.total.bytes_allocated == 4'000'000);
+        }
+    });
+    assert(worker_scopes == 4000);
+
+    // impossible sizes fail instead of wrapping around with the header's room added
+    volatile size_t huge = SIZE_MAX - 4;
+    bool thrown = false;
+    try
+    {
+        ::operator delete(::operator new(huge));
+    }
+    catch (const std::bad_alloc&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(::operator new(huge, std::nothrow) == nullptr);
+    assert(::operator new(huge, std::align_val_t{64}, std::nothrow) == nullptr);
+
+    alloc_profiler::report(stderr);
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+// Counting memory allocations, to be able to say "there're no allocations here" in tests,
+// or report allocations per operation in benchmarks.
+//
+// Works by replacing global `operator new`/`operator delete` (all of them, including sized and aligned ones).
+// Replacements can only be defined once per program, so do
+//
+//  #define ALLOC_PROFILER_IMPLEMENTATION
+//  #include "alloc_profiler.h"
+//
+// in exactly one .cpp file (the same trick single-header libraries like stb use).
+//
+// Use:
+//  {
+//      alloc_profiler::scope allocs{"parse"};
+//      parse(...);
+//      assert(allocs.allocations() == 0);
+//  }
+//  alloc_profiler::report(stderr);  // totals and all the named scopes
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace alloc_profiler
+{
+    struct counters
+    {
+        size_t allocations = 0;
+        size_t frees = 0;
+        size_t bytes_allocated = 0;
+        size_t bytes_freed = 0;
+
+        size_t live_bytes() const { return bytes_allocated - bytes_freed; }
+    };
+
+    // All threads together. Note that `peak_live_bytes` is only updated by the hooks,
+    // so it's exact, but relatively expensive (atomic max on every allocation).
+    struct totals
+    {
+        counters total;
+        size_t peak_live_bytes = 0;
+    };
+
+    inline totals global();
+    // resets peak to the current live size, e.g. to measure peak of a particular phase
+    inline void reset_peak();
+
+    // Current thread only. Cheap: no atomics involved.
+    inline counters this_thread();
+
+    // Counts allocations made by the current thread while it's alive.
+    // Scopes can be nested; inner scope counts are added to the outer scope when it's destroyed.
+    // Scopes with a name are also accumulated in a global table (see `report` and `for_each_scope`).
+    // The name must be a string literal (or otherwise outlive the program).
+    class scope
+    {
+    public:
+        inline explicit scope(const char* name = nullptr);
+        inline ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        size_t allocations() const { return counters_.allocations; }
+        size_t frees() const { return counters_.frees; }
+        size_t bytes_allocated() const { return counters_.bytes_allocated; }
+        size_t bytes_freed() const { return counters_.bytes_freed; }
+        const counters& get() const { return counters_; }
+        void reset() { counters_ = {}; }
+
+    private:
+        friend struct hooks;
+        const char* name_;
+        scope* parent_;
+        counters counters_;
+    };
+
+    // per-name accumulated counters of all the `scope`s destroyed so far, in all threads.
+    struct scope_totals
+    {
+        const char* name;
+        size_t entered;
+        counters total;
+    };
+
+    template<typename FuncT>
+    void for_each_scope(FuncT func);
+
+    inline void report(std::FILE* out);
+}
+
+// Implementation details: everything below doesn't allocate, since it's called from `operator new`.
+namespace alloc_profiler
+{
+    namespace details
+    {
+        struct atomic_counters
+        {
+            std::atomic<size_t> allocations{0};
+            std::atomic<size_t> frees{0};
+            std::atomic<size_t> bytes_allocated{0};
+            std::atomic<size_t> bytes_freed{0};
+
+            void add(const counters& c)
+            {
+                allocations.fetch_add(c.allocations, std::memory_order_relaxed);
+                frees.fetch_add(c.frees, std::memory_order_relaxed);
+                bytes_allocated.fetch_add(c.bytes_allocated, std::memory_order_relaxed);
+                bytes_freed.fetch_add(c.bytes_freed, std::memory_order_relaxed);
+            }
+
+            counters load() const
+            {
+                return {allocations.load(std::memory_order_relaxed), frees.load(std::memory_order_relaxed),
+                        bytes_allocated.load(std::memory_order_relaxed), bytes_freed.load(std::memory_order_relaxed)};
+            }
+        };
+
+        struct scope_entry
+        {
+            std::atomic<const char*> name{nullptr};
+            std::atomic<size_t> entered{0};
+            atomic_counters total;
+        };
+
+        // fixed size, so it's never allocated; extra names are just not recorded.
+        constexpr size_t max_scopes = 128;
+
+        struct state
+        {
+            atomic_counters total;
+            std::atomic<size_t> live_bytes{0};
+            std::atomic<size_t> peak_live_bytes{0};
+            scope_entry scopes[max_scopes];
+        };
+
+        // `inline` variables are shared by all translation units
+        inline state global_state;
+        inline thread_local counters thread_counters;
+        inline thread_local scope* current_scope = nullptr;
+
+        inline scope_entry* find_scope(const char* name)
+        {
+            for (auto& entry : global_state.scopes)
+            {
+                auto entry_name = entry.name.load(std::memory_order_acquire);
+                if (!entry_name)
+                {
+                    // free slot: try to take it (somebody else may take it first, with the same name or not)
+                    if (entry.name.compare_exchange_strong(entry_name, name, std::memory_order_acq_rel))
+                    {
+                        return &entry;
+                    }
+                }
+                if (entry_name == name || std::strcmp(entry_name, name) == 0)
+                {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    struct hooks
+    {
+        static void on_allocate(size_t size)
+        {
+            using namespace details;
+            thread_counters.allocations++;
+            thread_counters.bytes_allocated += size;
+            if (current_scope)
+            {
+                current_scope->counters_.allocations++;
+                current_scope->counters_.bytes_allocated += size;
+            }
+            global_state.total.allocations.fetch_add(1, std::memory_order_relaxed);
+            global_state.total.bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+            auto live = global_state.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+            auto peak = global_state.peak_live_bytes.load(std::memory_order_relaxed);
+            while (live > peak
+                   && !global_state.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        static void on_free(size_t size)
+        {
+            using namespace details;
+            thread_counters.frees++;
+            thread_counters.bytes_freed += size;
+            if (current_scope)
+            {
+                current_scope->counters_.frees++;
+                current_scope->counters_.bytes_freed += size;
+            }
+            global_state.total.frees.fetch_add(1, std::memory_order_relaxed);
+            global_state.total.bytes_freed.fetch_add(size, std::memory_order_relaxed);
+            global_state.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+        }
+    };
+
+    inline totals global()
+    {
+        return {details::global_state.total.load(), details::global_state.peak_live_bytes.load(std::memory_order_relaxed)};
+    }
+
+    inline void reset_peak()
+    {
+        details::global_state.peak_live_bytes.store(details::global_state.live_bytes.load(std::memory_order_relaxed),
+                                                    std::memory_order_relaxed);
+    }
+
+    inline counters this_thread()
+    {
+        return details::thread_counters;
+    }
+
+    inline scope::scope(const char* name)
+        : name_{name}, parent_{details::current_scope}
+    {
+        details::current_scope = this;
+    }
+
+    inline scope::~scope()
+    {
+        details::current_scope = parent_;
+        if (parent_)
+        {
+            parent_->counters_.allocations += counters_.allocations;
+            parent_->counters_.frees += counters_.frees;
+            parent_->counters_.bytes_allocated += counters_.bytes_allocated;
+            parent_->counters_.bytes_freed += counters_.bytes_freed;
+        }
+        if (name_)
+        {
+            if (auto entry = details::find_scope(name_))
+            {
+                entry->entered.fetch_add(1, std::memory_order_relaxed);
+                entry->total.add(counters_);
+            }
+        }
+    }
+
+    template<typename FuncT>
+    void for_each_scope(FuncT func)
+    {
+        for (auto& entry : details::global_state.scopes)
+        {
+            if (auto name = entry.name.load(std::memory_order_acquire))
+            {
+                func(scope_totals{name, entry.entered.load(std::memory_order_relaxed), entry.total.load()});
+            }
+        }
+    }
+
+    inline void report(std::FILE* out)
+    {
+        auto [total, peak] = global();
+        std::fprintf(out, "%-24s %12s %12s %14s %14s\n", "scope", "entered", "allocations", "bytes", "frees");
+        std::fprintf(out, "%-24s %12s %12zu %14zu %14zu (peak live %zu bytes)\n",
+                     "(total)", "", total.allocations, total.bytes_allocated, total.frees, peak);
+        for_each_scope([out](const scope_totals& s) {
+            std::fprintf(out, "%-24s %12zu %12zu %14zu %14zu\n",
+                         s.name, s.entered, s.total.allocations, s.total.bytes_allocated, s.total.frees);
+        });
+    }
+}
+
+#if defined(ALLOC_PROFILER_IMPLEMENTATION)
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace alloc_profiler::details
+{
+    // Every block has a header right before it, to know its size when it's freed
+    // (unsized `delete` doesn't tell) and the pointer to free (for over-aligned blocks).
+    struct block_header
+    {
+        size_t size;
+        void* raw;
+    };
+    static_assert(sizeof(block_header) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    inline void* allocate(size_t size, size_t alignment) noexcept
+    {
+        if (alignment < __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        {
+            alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+        }
+        // `size + alignment` mustn't wrap around to a small allocation
+        if (size > SIZE_MAX - alignment)
+        {
+            return nullptr;
+        }
+        // `malloc` gives memory aligned at least to the default alignment,
+        // so rounding `raw + alignment` down leaves at least the default alignment bytes for the header.
+        auto raw = static_cast<char*>(std::malloc(size + alignment));
+        if (!raw)
+        {
+            return nullptr;
+        }
+        auto address = (reinterpret_cast<uintptr_t>(raw) + alignment) & ~(uintptr_t(alignment) - 1);
+        auto p = reinterpret_cast<char*>(address);
+        reinterpret_cast<block_header*>(p)[-1] = {size, raw};
+        hooks::on_allocate(size);
+        return p;
+    }
+
+    inline void* allocate_or_throw(size_t size, size_t alignment)
+    {
+        if (auto p = allocate(size ? size : 1, alignment))
+        {
+            return p;
+        }
+        throw std::bad_alloc{};
+    }
+
+    inline void deallocate(void* p) noexcept
+    {
+        if (!p)
+        {
+            return;
+        }
+        auto header = static_cast<block_header*>(p)[-1];
+        hooks::on_free(header.size);
+        std::free(header.raw);
+    }
+}
+
+void* operator new(size_t size) { return alloc_profiler::details::allocate_or_throw(size, 0); }
+void* operator new[](size_t size) { return alloc_profiler::details::allocate_or_throw(size, 0); }
+void* operator new(size_t size, std::align_val_t al) { return alloc_profiler::details::allocate_or_throw(size, size_t(al)); }
+void* operator new[](size_t size, std::align_val_t al) { return alloc_profiler::details::allocate_or_throw(size, size_t(al)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return alloc_profiler::details::allocate(size ? size : 1, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return alloc_profiler::details::allocate(size ? size : 1, 0); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return alloc_profiler::details::allocate(size ? size : 1, size_t(al)); }
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return alloc_profiler::details::allocate(size ? size : 1, size_t(al)); }
+
+void operator delete(void* p) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete(void* p, size_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete(void* p, std::align_val_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alloc_profiler::details::deallocate(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alloc_profiler::details::deallocate(p); }
+#endif
@@ -0,0 +1,131 @@
+#include "async_generators.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a consumer: checks that the lines of a stream are "<stream> <line>"
+async_task check_lines(async_generator<std::string_view> lines, int stream, size_t& count)
+{
+    while (auto line = co_await lines.next())
+    {
+        auto expected = std::to_string(stream) + ' ' + std::to_string(count);
+        assert(*line == expected);
+        ++count;
+    }
+}
+
+async_task count_lines(async_generator<std::string_view> lines, size_t& count)
+{
+    // note the variable: GCC 12 loses the task with a bare `while (co_await lines.next())`
+    while ([[maybe_unused]] auto line = co_await lines.next())
+    {
+        ++count;
+    }
+}
+
+async_task fail(async_generator<std::string_view> lines)
+{
+    co_await lines.next();
+    throw std::runtime_error("oops");
+}
+
+int main()
+{
+    // many pipes on one thread, with data coming in small pieces
+    {
+        constexpr int streams = 200;
+        constexpr size_t lines = 1000;
+        std::vector<int> read_ends, write_ends;
+        for (int i = 0; i < streams; ++i)
+        {
+            int fds[2];
+            [[maybe_unused]] auto result = ::pipe(fds);
+            assert(result == 0);
+            read_ends.push_back(fds[0]);
+            write_ends.push_back(fds[1]);
+        }
+
+        // writes every stream a bit at a time, so the readers have to wait
+        std::thread writer{[&] {
+            for (size_t line = 0; line < lines; line += 10)
+            {
+                for (int i = 0; i < streams; ++i)
+                {
+                    std::string text;
+                    for (auto j = line; j < line + 10; ++j)
+                    {
+                        text += std::to_string(i) + ' ' + std::to_string(j) + '\n';
+                    }
+                    // may be split in two, so lines are split between chunks
+                    auto half = text.size() / 2;
+                    [[maybe_unused]] auto written = ::write(write_ends[i], text.data(), half);
+                    written = ::write(write_ends[i], text.data() + half, text.size() - half);
+                }
+            }
+            for (auto fd : write_ends)
+            {
+                ::close(fd);
+            }
+        }};
+
+        reactor loop;
+        std::vector<std::vector<char>> buffers(streams, std::vector<char>(256));
+        std::vector<size_t> counts(streams);
+        for (int i = 0; i < streams; ++i)
+        {
+            loop.spawn(check_lines(read_lines(read_chunks(loop, read_ends[i], buffers[i])), i, counts[i]));
+        }
+        loop.run();
+        writer.join();
+        for (int i = 0; i < streams; ++i)
+        {
+            assert(counts[i] == lines);
+            ::close(read_ends[i]);
+        }
+    }
+
+    // regular files just never wait
+    {
+        size_t expected = 0;
+        std::ifstream in{"README.md"};
+        for (std::string line; std::getline(in, line);)
+        {
+            ++expected;
+        }
+
+        auto fd = ::open("README.md", O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0);
+        reactor loop;
+        char buffer[4096];
+        size_t count = 0;
+        loop.spawn(count_lines(read_lines(read_chunks(loop, fd, buffer)), count));
+        loop.run();
+        ::close(fd);
+        std::fprintf(stderr, "README.md: %zu lines\n", count);
+        assert(count == expected && count > 0);
+    }
+
+    // an exception from a task is rethrown from `run()`
+    {
+        auto fd = ::open("README.md", O_RDONLY | O_CLOEXEC);
+        reactor loop;
+        char buffer[64];
+        loop.spawn(fail(read_chunks(loop, fd, buffer)));
+        bool thrown = false;
+        try
+        {
+            loop.run();
+        }
+        catch (const std::runtime_error& e)
+        {
+            thrown = std::string{e.what()} == "oops";
+        }
+        assert(thrown);
+        ::close(fd);
+    }
+}
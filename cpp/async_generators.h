@@ -0,0 +1,447 @@
+#pragma once
+
+// Async generators: coroutines that `co_yield` values like generators (see `generators.h`),
+// but can also `co_await` I/O, plus a single-threaded epoll reactor that resumes them when their file descriptors
+// are ready. So many streams are read on one thread instead of one blocked thread per stream.
+//
+// Use:
+//  async_task count_bytes(async_generator<std::string_view> chunks, size_t& total)
+//  {
+//      while (auto chunk = co_await chunks.next()) { total += chunk->size(); }
+//  }
+//
+//  reactor loop;
+//  char buffer[4096];
+//  loop.spawn(count_bytes(read_chunks(loop, fd, buffer), total));
+//  loop.run();  // returns when all spawned tasks are finished
+//
+// Linux only (epoll). Regular files can't be polled (and reading them never returns `EAGAIN`),
+// so waiting on a regular file resumes right away.
+
+#include "generators.h"
+#include "handle_wrapper.h"
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+class reactor;
+
+// A coroutine producing values asynchronously: `co_yield` gives a value to the consumer,
+// `co_await` (e.g. `co_await loop.readable(fd)`) suspends it till the reactor resumes it.
+// The consumer is a coroutine too, it gets the values with `co_await gen.next()`.
+// Control goes from one to another directly (symmetric transfer), the reactor is only involved in waiting.
+template<typename T>
+class async_generator
+{
+public:
+    struct promise_type
+    {
+        const T* value_ = nullptr;  // the yielded value lives in the suspended generator, no copies
+        std::coroutine_handle<> consumer_;
+        std::exception_ptr error_;
+
+        async_generator get_return_object()
+        {
+            return async_generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept { return to_consumer{}; }
+        auto yield_value(const T& value) noexcept
+        {
+            value_ = &value;
+            return to_consumer{};
+        }
+        void return_void() noexcept { value_ = nullptr; }
+        void unhandled_exception() noexcept
+        {
+            value_ = nullptr;
+            error_ = std::current_exception();
+        }
+
+        static void* operator new(size_t size) { return details::frame_pool::allocate(size); }
+        static void operator delete(void* p, size_t size) noexcept { details::frame_pool::deallocate(p, size); }
+    };
+
+    async_generator(async_generator&& other) noexcept
+        : handle_{std::exchange(other.handle_, nullptr)}
+    {
+    }
+    async_generator& operator=(async_generator&& other) noexcept
+    {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    ~async_generator()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    // `co_await gen.next()` runs the generator till its next `co_yield`
+    // and gives a pointer to the value, or `nullptr` when it's finished.
+    // The value is valid till the next call.
+    auto next()
+    {
+        struct awaiter
+        {
+            std::coroutine_handle<promise_type> generator;
+
+            bool await_ready() const noexcept { return generator.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+            {
+                generator.promise().consumer_ = consumer;
+                return generator;
+            }
+            const T* await_resume()
+            {
+                auto& promise = generator.promise();
+                if (auto error = std::exchange(promise.error_, nullptr))
+                {
+                    std::rethrow_exception(error);
+                }
+                return generator.done() ? nullptr : promise.value_;
+            }
+        };
+        return awaiter{handle_};
+    }
+
+private:
+    // back to whoever called `next()`
+    struct to_consumer
+    {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> generator) noexcept
+        {
+            return generator.promise().consumer_;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    explicit async_generator(std::coroutine_handle<promise_type> handle)
+        : handle_{handle}
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// A top-level coroutine run by the reactor (see `reactor::spawn`). The frame is freed when it's finished.
+class async_task
+{
+public:
+    struct promise_type
+    {
+        reactor* reactor_ = nullptr;
+
+        async_task get_return_object() { return async_task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        inline void return_void() noexcept;
+        inline void unhandled_exception() noexcept;
+
+        static void* operator new(size_t size) { return details::frame_pool::allocate(size); }
+        static void operator delete(void* p, size_t size) noexcept { details::frame_pool::deallocate(p, size); }
+    };
+
+    async_task(async_task&& other) noexcept
+        : handle_{std::exchange(other.handle_, nullptr)}
+    {
+    }
+    async_task& operator=(async_task&& other) noexcept
+    {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    // only owns the coroutine till it's started
+    ~async_task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+private:
+    friend class reactor;
+
+    explicit async_task(std::coroutine_handle<promise_type> handle)
+        : handle_{handle}
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+class reactor
+{
+public:
+    reactor()
+        : epoll_{::epoll_create1(EPOLL_CLOEXEC)}
+    {
+        if (epoll_ < 0)
+        {
+            throw std::system_error(errno, std::system_category(), "epoll_create1");
+        }
+    }
+
+    ~reactor()
+    {
+        ::close(epoll_);
+    }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    // The task starts in `run()` (or right away if `run()` is already running).
+    void spawn(async_task task)
+    {
+        task.handle_.promise().reactor_ = this;
+        pending_.push_back(std::move(task));
+    }
+
+    // Runs till all the tasks are finished. The first exception thrown by a task is rethrown here
+    // (after the other tasks are finished).
+    void run()
+    {
+        while (start_pending(), alive_ > 0)
+        {
+            // coroutines resumed here may add more
+            for (size_t i = 0; i < ready_.size(); ++i)
+            {
+                ready_[i].resume();
+            }
+            ready_.clear();
+            if (!pending_.empty() || alive_ == 0)
+            {
+                continue;
+            }
+            if (waiting_ == 0)
+            {
+                throw std::logic_error("reactor: tasks are suspended, but nothing waits for I/O");
+            }
+
+            epoll_event events[64];
+            auto count = ::epoll_wait(epoll_, events, std::size(events), -1);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "epoll_wait");
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                // edge-triggered: an edge without a waiter is dropped, the reader only waits after `EAGAIN` anyway
+                if (auto waiter = std::exchange(watches_[events[i].data.fd].waiter, nullptr))
+                {
+                    --waiting_;
+                    waiter.resume();
+                }
+            }
+        }
+        if (auto error = std::exchange(first_error_, nullptr))
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // `co_await loop.readable(fd)` suspends till there's something to read from `fd` (or it's closed).
+    // Only one coroutine may wait on a descriptor at a time.
+    auto readable(int fd)
+    {
+        struct awaiter
+        {
+            reactor& loop;
+            int fd;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> waiter) { loop.wait(fd, waiter); }
+            void await_resume() const noexcept {}
+        };
+        return awaiter{*this, fd};
+    }
+
+    // Call before closing a descriptor that was waited on: its number can be reused by another one.
+    void forget(int fd) noexcept
+    {
+        if (size_t(fd) >= watches_.size())
+        {
+            return;
+        }
+        auto& watch = watches_[fd];
+        if (watch.state == watch_state::polled)
+        {
+            ::epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        if (watch.waiter)
+        {
+            --waiting_;
+        }
+        watch = {};
+    }
+
+private:
+    friend struct async_task::promise_type;
+
+    enum class watch_state : unsigned char { unknown, polled, always_ready };
+
+    struct watch
+    {
+        std::coroutine_handle<> waiter;
+        watch_state state = watch_state::unknown;
+    };
+
+    void start_pending()
+    {
+        for (auto& task : pending_)
+        {
+            ready_.push_back(std::exchange(task.handle_, nullptr));
+            ++alive_;
+        }
+        pending_.clear();
+    }
+
+    void wait(int fd, std::coroutine_handle<> waiter)
+    {
+        if (size_t(fd) >= watches_.size())
+        {
+            watches_.resize(fd + 1);
+        }
+        auto& watch = watches_[fd];
+        if (watch.state == watch_state::unknown)
+        {
+            // registered once, edge-triggered: no syscalls per wait
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+            event.data.fd = fd;
+            if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) == 0)
+            {
+                watch.state = watch_state::polled;
+            }
+            else if (errno == EPERM)
+            {
+                watch.state = watch_state::always_ready;
+            }
+            else
+            {
+                throw std::system_error(errno, std::system_category(), "epoll_ctl");
+            }
+        }
+        if (watch.state == watch_state::always_ready)
+        {
+            ready_.push_back(waiter);
+            return;
+        }
+        if (watch.waiter)
+        {
+            throw std::logic_error("reactor: a descriptor is already waited on");
+        }
+        watch.waiter = waiter;
+        ++waiting_;
+    }
+
+    void finished(std::exception_ptr error) noexcept
+    {
+        --alive_;
+        if (error && !first_error_)
+        {
+            first_error_ = error;
+        }
+    }
+
+    int epoll_;
+    std::vector<async_task> pending_;
+    std::vector<std::coroutine_handle<>> ready_;
+    std::vector<watch> watches_;    // by descriptor: they are small numbers
+    size_t alive_ = 0;
+    size_t waiting_ = 0;
+    std::exception_ptr first_error_;
+};
+
+inline void async_task::promise_type::return_void() noexcept
+{
+    reactor_->finished(nullptr);
+}
+
+inline void async_task::promise_type::unhandled_exception() noexcept
+{
+    reactor_->finished(std::current_exception());
+}
+
+// Reads `fd` chunk by chunk into `buffer` (each chunk is valid till the next one is requested).
+// The descriptor is switched to non-blocking mode, and it's not closed at the end.
+inline async_generator<std::string_view> read_chunks(reactor& loop, int fd, std::span<char> buffer)
+{
+    if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "fcntl");
+    }
+    scope_guard forget{[&loop, fd] { loop.forget(fd); }};
+    for (;;)
+    {
+        auto size = ::read(fd, buffer.data(), buffer.size());
+        if (size > 0)
+        {
+            co_yield std::string_view{buffer.data(), size_t(size)};
+        }
+        else if (size == 0)
+        {
+            co_return;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            co_await loop.readable(fd);
+        }
+        else if (errno != EINTR)
+        {
+            throw std::system_error(errno, std::system_category(), "read");
+        }
+    }
+}
+
+// Splits chunks into lines (without the '\n'). A line is yielded right from the chunk,
+// unless it's split between chunks: then it's glued together in a string.
+inline async_generator<std::string_view> read_lines(async_generator<std::string_view> chunks)
+{
+    std::string partial;
+    while (auto chunk = co_await chunks.next())
+    {
+        auto rest = *chunk;
+        for (auto end = rest.find('\n'); end != rest.npos; end = rest.find('\n'))
+        {
+            if (partial.empty())
+            {
+                co_yield rest.substr(0, end);
+            }
+            else
+            {
+                partial.append(rest, 0, end);
+                co_yield std::string_view{partial};
+                partial.clear();
+            }
+            rest.remove_prefix(end + 1);
+        }
+        partial.append(rest);
+    }
+    if (!partial.empty())
+    {
+        co_yield std::string_view{partial};
+    }
+}
@@ -0,0 +1,3 @@
+// global `operator new` and `operator delete` for the benchmarks
+#define ALLOC_PROFILER_IMPLEMENTATION
+#include "alloc_profiler.h"
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "alloc_profiler.h"
+
+#include <benchmark/benchmark.h>
+
+// Reports allocations made by the benchmark thread while it's alive as "allocs/op" and "bytes/op".
+// Create it right before the benchmark loop:
+//
+//  alloc_report report{state};
+//  for (auto _ : state) { ... }
+struct alloc_report
+{
+    benchmark::State& state;
+    alloc_profiler::scope allocs{};
+
+    ~alloc_report()
+    {
+        using benchmark::Counter;
+        state.counters["allocs/op"] = Counter(double(allocs.allocations()), Counter::kAvgIterations);
+        state.counters["bytes/op"] = Counter(double(allocs.bytes_allocated()), Counter::kAvgIterations);
+    }
+};
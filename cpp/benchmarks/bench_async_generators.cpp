@@ -0,0 +1,163 @@
+#include "async_generators.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+// Reading many streams: a thread per stream (blocking `read`) vs one thread with the reactor.
+namespace
+{
+    constexpr size_t stream_size = 256 * 1024;
+    constexpr size_t chunk_size = 4096;
+
+    // Counts bytes of every stream (so the reading is not optimized away).
+    using reader = void (*)(const std::vector<int>& fds, std::vector<size_t>& sizes);
+
+    void read_with_threads(const std::vector<int>& fds, std::vector<size_t>& sizes)
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            threads.emplace_back([fd = fds[i], &size = sizes[i]] {
+                char buffer[chunk_size];
+                for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;)
+                {
+                    size += n;
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    async_task count_bytes(async_generator<std::string_view> chunks, size_t& size)
+    {
+        while (auto chunk = co_await chunks.next())
+        {
+            size += chunk->size();
+        }
+    }
+
+    void read_with_reactor(const std::vector<int>& fds, std::vector<size_t>& sizes)
+    {
+        reactor loop;
+        std::vector<char> buffers(fds.size() * chunk_size);
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            loop.spawn(count_bytes(read_chunks(loop, fds[i], {buffers.data() + i * chunk_size, chunk_size}), sizes[i]));
+        }
+        loop.run();
+    }
+
+    // pipes, with a writer thread feeding them round-robin
+    void pipes(benchmark::State& state, reader read)
+    {
+        const auto streams = size_t(state.range(0));
+        for (auto _ : state)
+        {
+            std::vector<int> read_ends, write_ends;
+            for (size_t i = 0; i < streams; ++i)
+            {
+                int fds[2];
+                if (::pipe(fds) != 0)
+                {
+                    state.SkipWithError("pipe failed");
+                    return;
+                }
+                read_ends.push_back(fds[0]);
+                write_ends.push_back(fds[1]);
+            }
+            std::thread writer{[&] {
+                const std::string chunk(chunk_size, 'x');
+                for (size_t written = 0; written < stream_size; written += chunk_size)
+                {
+                    for (auto fd : write_ends)
+                    {
+                        [[maybe_unused]] auto result = ::write(fd, chunk.data(), chunk.size());
+                    }
+                }
+                for (auto fd : write_ends)
+                {
+                    ::close(fd);
+                }
+            }};
+
+            std::vector<size_t> sizes(streams);
+            read(read_ends, sizes);
+            writer.join();
+            for (auto fd : read_ends)
+            {
+                ::close(fd);
+            }
+            benchmark::DoNotOptimize(sizes.data());
+        }
+        state.SetBytesProcessed(state.iterations() * streams * stream_size);
+    }
+
+    void BM_pipes_thread_per_stream(benchmark::State& state) { pipes(state, read_with_threads); }
+    BENCHMARK(BM_pipes_thread_per_stream)->Arg(16)->Arg(256)->UseRealTime();
+
+    void BM_pipes_reactor(benchmark::State& state) { pipes(state, read_with_reactor); }
+    BENCHMARK(BM_pipes_reactor)->Arg(16)->Arg(256)->UseRealTime();
+
+    // local files (in the page cache after the first iteration)
+    struct temp_files
+    {
+        std::vector<std::string> paths;
+
+        explicit temp_files(size_t count)
+        {
+            const std::string data(stream_size, 'x');
+            for (size_t i = 0; i < count; ++i)
+            {
+                char path[] = "/tmp/bench_async_XXXXXX";
+                auto fd = ::mkstemp(path);
+                [[maybe_unused]] auto result = ::write(fd, data.data(), data.size());
+                ::close(fd);
+                paths.push_back(path);
+            }
+        }
+        ~temp_files()
+        {
+            for (auto& path : paths)
+            {
+                std::remove(path.c_str());
+            }
+        }
+    };
+
+    void files(benchmark::State& state, reader read)
+    {
+        const auto streams = size_t(state.range(0));
+        temp_files temp{streams};
+        for (auto _ : state)
+        {
+            std::vector<int> fds;
+            for (auto& path : temp.paths)
+            {
+                fds.push_back(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+            }
+            std::vector<size_t> sizes(streams);
+            read(fds, sizes);
+            for (auto fd : fds)
+            {
+                ::close(fd);
+            }
+            benchmark::DoNotOptimize(sizes.data());
+        }
+        state.SetBytesProcessed(state.iterations() * streams * stream_size);
+    }
+
+    void BM_files_thread_per_stream(benchmark::State& state) { files(state, read_with_threads); }
+    BENCHMARK(BM_files_thread_per_stream)->Arg(16)->Arg(256)->UseRealTime();
+
+    void BM_files_reactor(benchmark::State& state) { files(state, read_with_reactor); }
+    BENCHMARK(BM_files_reactor)->Arg(16)->Arg(256)->UseRealTime();
+}
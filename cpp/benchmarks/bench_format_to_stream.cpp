@@ -0,0 +1,42 @@
+#include "format_to_stream.h"
+#include "alloc_counters.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    void BM_stream_tuple(benchmark::State& state)
+    {
+        const auto t = std::tuple(42, std::string("forty two"), 42.0);
+        std::ostringstream os;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            os.str({});
+            os << t;
+            benchmark::DoNotOptimize(os);
+        }
+    }
+    BENCHMARK(BM_stream_tuple);
+
+    void BM_stream_vector(benchmark::State& state)
+    {
+        std::vector<int> v(state.range(0));
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            v[i] = static_cast<int>(i * 7919);
+        }
+        std::ostringstream os;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            os.str({});
+            os << v;
+            benchmark::DoNotOptimize(os);
+        }
+        state.SetItemsProcessed(state.iterations() * v.size());
+    }
+    BENCHMARK(BM_stream_vector)->Arg(10)->Arg(1000);
+}
@@ -0,0 +1,203 @@
+#include "format_to_string.h"
+#include "alloc_counters.h"
+
+#include <cstdio>
+#if __has_include(<format>)
+#include <format>
+#endif
+
+using namespace std::literals;
+
+namespace
+{
+    // a typical report line: aligned columns, hex ids and fixed-point numbers
+    const std::string name = "some.metric.name";
+
+    void BM_snprintf(benchmark::State& state)
+    {
+        char buf[128];
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(
+                std::snprintf(buf, sizeof(buf), "%-20s|%8u|%08x|%10.3f", name.c_str(), i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_snprintf);
+
+    void BM_format_to_n(benchmark::State& state)
+    {
+        char buf[128];
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(
+                format_to_n(buf, sizeof(buf), "%{0:<20}|%{1:>8}|%{2:08x}|%{3:10.3f}", name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_format_to_n);
+
+    void BM_format_to_n_compiled(benchmark::State& state)
+    {
+        char buf[128];
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(
+                format_to_n<"%{0:<20}|%{1:>8}|%{2:08x}|%{3:10.3f}">(buf, sizeof(buf), name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_format_to_n_compiled);
+
+    void BM_format(benchmark::State& state)
+    {
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(format("%{0:<20}|%{1:>8}|%{2:08x}|%{3:10.3f}", name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_format);
+
+    void BM_format_compiled(benchmark::State& state)
+    {
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(format<"%{0:<20}|%{1:>8}|%{2:08x}|%{3:10.3f}">(name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_format_compiled);
+
+    void BM_format_append(benchmark::State& state)
+    {
+        std::string buffer;
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            buffer.clear();
+            format_append<"%{0:<20}|%{1:>8}|%{2:08x}|%{3:10.3f}">(buffer, name, i, i * 7919u, i / 7.0);
+            benchmark::DoNotOptimize(buffer.data());
+        }
+    }
+    BENCHMARK(BM_format_append);
+
+#if defined(__cpp_lib_format)
+    void BM_std_format_to_n(benchmark::State& state)
+    {
+        char buf[128];
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(
+                std::format_to_n(buf, sizeof(buf), "{:<20}|{:>8}|{:08x}|{:10.3f}", name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_std_format_to_n);
+
+    void BM_std_format(benchmark::State& state)
+    {
+        unsigned i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(std::format("{:<20}|{:>8}|{:08x}|{:10.3f}", name, i, i * 7919u, i / 7.0));
+        }
+    }
+    BENCHMARK(BM_std_format);
+#endif
+
+    void BM_concat(benchmark::State& state)
+    {
+        const char* bang = "!!!!";
+        const std::string hello = "Hello"s;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(concat(hello, " dear ", "world"sv, bang));
+        }
+    }
+    BENCHMARK(BM_concat);
+
+    void BM_concat_numbers(benchmark::State& state)
+    {
+        int i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ++i;
+            benchmark::DoNotOptimize(concat("request #", i, " took ", i / 1000.0, " ms, ok=", i % 2 == 0));
+        }
+    }
+    BENCHMARK(BM_concat_numbers);
+
+    // Scanning for markers. Arg is the number of repeats of a literal-heavy line with one marker.
+    std::string make_template(int64_t lines)
+    {
+        std::string result;
+        for (int64_t i = 0; i < lines; ++i)
+        {
+            concat_append(result, "line ", i, ": some literal text which is just copied to output, %{0:>8} ");
+        }
+        return result;
+    }
+
+    template<typename FindT>
+    void scan_markers(benchmark::State& state, FindT find)
+    {
+        const auto tmpl = make_template(state.range(0));
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (auto i = find(tmpl, 0, '%'); i < tmpl.size(); i = find(tmpl, i + 1, '%'))
+            {
+                ++n;
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * tmpl.size());
+    }
+
+    void BM_scan_markers_scalar(benchmark::State& state)
+    {
+        scan_markers(state, details::find_char_scalar);
+    }
+    BENCHMARK(BM_scan_markers_scalar)->Arg(1)->Arg(50);
+
+    void BM_scan_markers_simd(benchmark::State& state)
+    {
+        scan_markers(state, details::find_char_simd);
+    }
+    BENCHMARK(BM_scan_markers_simd)->Arg(1)->Arg(50);
+
+    void BM_format_long_template(benchmark::State& state)
+    {
+        const auto tmpl = make_template(state.range(0));
+        std::string buffer;
+        int i = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            buffer.clear();
+            format_append(buffer, tmpl, ++i);
+            benchmark::DoNotOptimize(buffer.data());
+        }
+        state.SetBytesProcessed(state.iterations() * tmpl.size());
+    }
+    BENCHMARK(BM_format_long_template)->Arg(1)->Arg(50);
+}
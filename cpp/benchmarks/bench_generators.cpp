@@ -0,0 +1,185 @@
+#include "generators.h"
+#include "alloc_counters.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    $generator(fib, long long(int)) {
+        long long a = 1, b = 1;
+        int i;
+        $start;
+        for (i = 0; i < arg<0>(); ++i) {
+            $yield(a);
+            auto n = a + b;
+            a = b; b = n;
+        }
+        $stop;
+    };
+
+    void BM_generator_fib(benchmark::State& state)
+    {
+        const auto count = static_cast<int>(state.range(0));
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            long long sum = 0;
+            for (const auto& n : fib{int{count}})
+            {
+                sum += n;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_generator_fib)->Arg(10)->Arg(90);
+
+    // yields a string field: `$yield` copies it into the iterator every time
+    $generator(lines, std::string(int)) {
+        std::string line;
+        int i;
+        $start;
+        for (i = 0; i < arg<0>(); ++i) {
+            line.assign(100, char('a' + i % 26));
+            $yield(line);
+        }
+        $stop;
+    };
+
+    void BM_generator_lines(benchmark::State& state)
+    {
+        const auto count = static_cast<int>(state.range(0));
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t sum = 0;
+            for (const auto& line : lines{int{count}})
+            {
+                sum += line.size() + line[0];
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_generator_lines)->Arg(10)->Arg(1000);
+
+    // a pipeline vs the same filtering written in the loop body
+    void BM_generator_fib_filter_loop(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            long long sum = 0;
+            int taken = 0;
+            for (const auto& n : fib{90})
+            {
+                if (n % 3 == 0)
+                {
+                    sum += n / 3;
+                    if (++taken == 20)
+                    {
+                        break;
+                    }
+                }
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    BENCHMARK(BM_generator_fib_filter_loop);
+
+    void BM_generator_fib_pipes(benchmark::State& state)
+    {
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            long long sum = 0;
+            for (auto n : fib{90} | pipes::filter([](long long n) { return n % 3 == 0; })
+                              | pipes::map([](long long n) { return n / 3; }) | pipes::take(20))
+            {
+                sum += n;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    BENCHMARK(BM_generator_fib_pipes);
+
+    // one value at a time vs batches: the loop over a batch is vectorized
+    std::vector<float> make_samples()
+    {
+        std::vector<float> samples(4096);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            samples[i] = float(i * 7919 % 1000) / 1000.0f;
+        }
+        return samples;
+    }
+    const auto samples = make_samples();
+    const auto above = [](float x) { return x > 0.1f; };
+
+    float polynomial(float x)
+    {
+        // something heavy enough to be worth vectorizing
+        float y = 0.5f;
+        for (int i = 0; i < 16; ++i)
+        {
+            y = y * x + 0.25f * float(i);
+        }
+        return y;
+    }
+
+    void BM_pipes_filter_transform(benchmark::State& state)
+    {
+        std::vector<float> out(samples.size());
+        for (auto _ : state)
+        {
+            size_t size = 0;
+            for (auto x : samples | pipes::filter(above))
+            {
+                out[size++] = polynomial(x);
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * samples.size());
+    }
+    BENCHMARK(BM_pipes_filter_transform);
+
+    void BM_pipes_filter_batch_transform(benchmark::State& state)
+    {
+        std::vector<float> out(samples.size());
+        for (auto _ : state)
+        {
+            size_t size = 0;
+            for (auto chunk : samples | pipes::filter(above) | pipes::batch<64>())
+            {
+                auto dest = out.data() + size;
+                for (size_t i = 0; i < chunk.size(); ++i)
+                {
+                    dest[i] = polynomial(chunk[i]);
+                }
+                size += chunk.size();
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * samples.size());
+    }
+    BENCHMARK(BM_pipes_filter_batch_transform);
+
+    // the same thing written as a plain loop, for reference
+    void BM_loop_fib(benchmark::State& state)
+    {
+        const auto count = static_cast<int>(state.range(0));
+        for (auto _ : state)
+        {
+            long long sum = 0, a = 1, b = 1;
+            for (int i = 0; i < count; ++i)
+            {
+                sum += a;
+                auto n = a + b;
+                a = b; b = n;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_loop_fib)->Arg(10)->Arg(90);
+}
@@ -0,0 +1,67 @@
+// the same generators as in `bench_generators.cpp`, with the coroutine backend
+#define GENERATOR_COROUTINES
+#include "generators.h"
+#include "alloc_counters.h"
+
+#include <string>
+
+namespace
+{
+    $generator(fib, long long(int)) {
+        long long a = 1, b = 1;
+        int i;
+        $start;
+        for (i = 0; i < arg<0>(); ++i) {
+            $yield(a);
+            auto n = a + b;
+            a = b; b = n;
+        }
+        $stop;
+    };
+
+    void BM_coroutine_generator_fib(benchmark::State& state)
+    {
+        const auto count = static_cast<int>(state.range(0));
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            long long sum = 0;
+            for (const auto& n : fib{int{count}})
+            {
+                sum += n;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_coroutine_generator_fib)->Arg(10)->Arg(90);
+
+    // yields a string field: the iterator refers to it, nothing is copied
+    $generator(lines, std::string(int)) {
+        std::string line;
+        int i;
+        $start;
+        for (i = 0; i < arg<0>(); ++i) {
+            line.assign(100, char('a' + i % 26));
+            $yield(line);
+        }
+        $stop;
+    };
+
+    void BM_coroutine_generator_lines(benchmark::State& state)
+    {
+        const auto count = static_cast<int>(state.range(0));
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t sum = 0;
+            for (const auto& line : lines{int{count}})
+            {
+                sum += line.size() + line[0];
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_coroutine_generator_lines)->Arg(10)->Arg(1000);
+}
@@ -0,0 +1,244 @@
+#include "handle_wrapper.h"
+#include "alloc_counters.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// Reading the first line of one of a few small files, again and again: opening and closing every time
+// vs taking the handles from `FileHandlePool` (with one lock and with sharded locks, from several threads).
+namespace
+{
+    constexpr size_t file_count = 64;
+
+    struct temp_files
+    {
+        std::vector<std::string> paths;
+
+        temp_files()
+        {
+            for (size_t i = 0; i < file_count; ++i)
+            {
+                char path[] = "/tmp/bench_handles_XXXXXX";
+                auto fd = ::mkstemp(path);
+                auto line = "line " + std::to_string(i) + "\n";
+                [[maybe_unused]] auto result = ::write(fd, line.data(), line.size());
+                ::close(fd);
+                paths.push_back(path);
+            }
+        }
+        ~temp_files()
+        {
+            for (auto &path : paths)
+            {
+                std::remove(path.c_str());
+            }
+        }
+    };
+
+    const temp_files &files()
+    {
+        static temp_files files;
+        return files;
+    }
+
+    void BM_open_close(benchmark::State &state)
+    {
+        auto &paths = files().paths;
+        size_t i = state.thread_index();
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            FileHandle file{paths[i++ % file_count], FileHandle::READONLY};
+            char buf[64];
+            file.get_string(buf);
+            benchmark::DoNotOptimize(buf);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_open_close)->Threads(1)->Threads(4)->UseRealTime();
+
+    void pooled(benchmark::State &state, FileHandlePool &pool)
+    {
+        auto &paths = files().paths;
+        size_t i = state.thread_index();
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            auto file = pool.acquire(paths[i++ % file_count], FileHandle::READONLY);
+            char buf[64];
+            std::fgets(buf, sizeof(buf), file);
+            benchmark::DoNotOptimize(buf);
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0)
+        {
+            state.counters["hit_rate"] = pool.stats().hit_rate();
+        }
+    }
+
+    void BM_pool_one_lock(benchmark::State &state)
+    {
+        static FileHandlePool pool{2 * file_count, 1};
+        pooled(state, pool);
+    }
+    BENCHMARK(BM_pool_one_lock)->Threads(1)->Threads(4)->UseRealTime();
+
+    void BM_pool_sharded(benchmark::State &state)
+    {
+        static FileHandlePool pool{2 * file_count, 16};
+        pooled(state, pool);
+    }
+    BENCHMARK(BM_pool_sharded)->Threads(1)->Threads(4)->UseRealTime();
+
+    // Reading all lines of a big file (from the page cache after the first iteration): `fgets` vs `FileReader`,
+    // for a regular file (mapped) and for a pipe (read into the buffer).
+    constexpr size_t big_file_size = 64 << 20;
+
+    struct big_file
+    {
+        std::string path;
+        std::string text;
+
+        big_file()
+        {
+            // lines of 10 to 150 characters
+            for (unsigned i = 0; text.size() < big_file_size; ++i)
+            {
+                text.append(10 + (i * 2654435761u) % 140, 'a' + i % 26);
+                text += '\n';
+            }
+            char name[] = "/tmp/bench_lines_XXXXXX";
+            auto fd = ::mkstemp(name);
+            for (size_t done = 0; done < text.size();)
+            {
+                auto written = ::write(fd, text.data() + done, text.size() - done);
+                if (written <= 0)
+                {
+                    break;
+                }
+                done += size_t(written);
+            }
+            ::close(fd);
+            path = name;
+        }
+        ~big_file()
+        {
+            std::remove(path.c_str());
+        }
+    };
+
+    const big_file &lines_file()
+    {
+        static big_file file;
+        return file;
+    }
+
+    // the other end of the pipe is written by a thread
+    struct pipe_writer
+    {
+        int read_fd;
+        std::thread writer;
+
+        explicit pipe_writer(const std::string &text)
+        {
+            int fds[2];
+            [[maybe_unused]] auto result = ::pipe(fds);
+            read_fd = fds[0];
+            writer = std::thread{[fd = fds[1], &text] {
+                for (size_t done = 0; done < text.size();)
+                {
+                    auto written = ::write(fd, text.data() + done, text.size() - done);
+                    if (written <= 0)
+                    {
+                        break;
+                    }
+                    done += size_t(written);
+                }
+                ::close(fd);
+            }};
+        }
+        ~pipe_writer()
+        {
+            writer.join();
+        }
+    };
+
+    size_t count_with_fgets(FILE *file)
+    {
+        size_t bytes = 0;
+        char buf[4096];
+        while (std::fgets(buf, sizeof(buf), file))
+        {
+            bytes += std::strlen(buf);
+        }
+        return bytes;
+    }
+
+    size_t count_with_reader(FileReader &reader)
+    {
+        size_t bytes = 0;
+        for (std::string_view line : reader.lines())
+        {
+            bytes += line.size() + 1;
+        }
+        return bytes;
+    }
+
+    void BM_lines_fgets(benchmark::State &state)
+    {
+        auto &file = lines_file();
+        for (auto _ : state)
+        {
+            FileHandle handle{file.path, FileHandle::READONLY};
+            benchmark::DoNotOptimize(count_with_fgets(handle));
+        }
+        state.SetBytesProcessed(state.iterations() * file.text.size());
+    }
+    BENCHMARK(BM_lines_fgets)->Unit(benchmark::kMillisecond);
+
+    void BM_lines_file_reader(benchmark::State &state)
+    {
+        auto &file = lines_file();
+        for (auto _ : state)
+        {
+            FileReader reader{file.path};
+            benchmark::DoNotOptimize(count_with_reader(reader));
+        }
+        state.SetBytesProcessed(state.iterations() * file.text.size());
+    }
+    BENCHMARK(BM_lines_file_reader)->Unit(benchmark::kMillisecond);
+
+    void BM_pipe_lines_fgets(benchmark::State &state)
+    {
+        auto &file = lines_file();
+        for (auto _ : state)
+        {
+            pipe_writer pipe{file.text};
+            auto handle = wrapHandle(::fdopen(pipe.read_fd, "r"), &std::fclose);
+            benchmark::DoNotOptimize(count_with_fgets(handle));
+        }
+        state.SetBytesProcessed(state.iterations() * file.text.size());
+    }
+    BENCHMARK(BM_pipe_lines_fgets)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+    void BM_pipe_lines_file_reader(benchmark::State &state)
+    {
+        auto &file = lines_file();
+        for (auto _ : state)
+        {
+            pipe_writer pipe{file.text};
+            FileReader reader{pipe.read_fd};
+            benchmark::DoNotOptimize(count_with_reader(reader));
+        }
+        state.SetBytesProcessed(state.iterations() * file.text.size());
+    }
+    BENCHMARK(BM_pipe_lines_file_reader)->Unit(benchmark::kMillisecond)->UseRealTime();
+}
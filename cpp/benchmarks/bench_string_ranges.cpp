@@ -0,0 +1,407 @@
+#include "string_ranges.h"
+#include "alloc_counters.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    // something like "   1:2, 3:10, 11:20" from the demo, but longer
+    std::string make_input(int64_t pairs)
+    {
+        std::string result;
+        for (int64_t i = 0; i < pairs; ++i)
+        {
+            result += " " + std::to_string(i) + ":" + std::to_string(i * 7 % 1000) + ",";
+        }
+        return result;
+    }
+
+    template<typename RangeT>
+    void split(benchmark::State& state, const char* delims)
+    {
+        const auto input = make_input(state.range(0));
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& sv : RangeT{input, delims})
+            {
+                n += sv.size();
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+
+    void BM_strpbrk_split_range(benchmark::State& state)
+    {
+        split<strpbrk_split_range>(state, ",:");
+    }
+    BENCHMARK(BM_strpbrk_split_range)->Arg(10)->Arg(10000);
+
+    void BM_split_range(benchmark::State& state)
+    {
+        split<split_range>(state, ",:");
+    }
+    BENCHMARK(BM_split_range)->Arg(10)->Arg(10000)->Arg(1000000);
+
+    // fields are long and delimiters are rare, as in logs split into lines
+    void BM_strpbrk_split_lines(benchmark::State& state)
+    {
+        split<strpbrk_split_range>(state, "\n\r");
+    }
+    BENCHMARK(BM_strpbrk_split_lines)->Arg(10000);
+
+    void BM_split_lines(benchmark::State& state)
+    {
+        split<split_range>(state, "\n\r");
+    }
+    BENCHMARK(BM_split_lines)->Arg(10000);
+
+    // more delimiters than SSE2 compares are used for
+    void BM_strpbrk_split_many_delims(benchmark::State& state)
+    {
+        split<strpbrk_split_range>(state, " \t,:;|");
+    }
+    BENCHMARK(BM_strpbrk_split_many_delims)->Arg(10000);
+
+    void BM_split_many_delims(benchmark::State& state)
+    {
+        split<split_range>(state, " \t,:;|");
+    }
+    BENCHMARK(BM_split_many_delims)->Arg(10000);
+
+    // what a parser would do with `split_range` to index the fields
+    void BM_split_range_collect(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        std::vector<size_t> offsets;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            offsets.clear();
+            for (const auto& sv : split_range{input, ",:"})
+            {
+                offsets.push_back(sv.data() + sv.size() - input.data());
+            }
+            benchmark::DoNotOptimize(offsets.data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * offsets.size());
+    }
+    BENCHMARK(BM_split_range_collect)->Arg(10)->Arg(10000)->Arg(1000000);
+
+    // all the delimiters of the input, compare with `BM_split_range_collect`
+    void BM_split_offsets(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        const char_set delims{",:"};
+        std::vector<size_t> offsets;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            split_offsets(input, delims, offsets);
+            benchmark::DoNotOptimize(offsets.data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * offsets.size());
+    }
+    BENCHMARK(BM_split_offsets)->Arg(10)->Arg(10000)->Arg(1000000);
+
+    // scaling with the number of threads
+    void BM_parallel_split_offsets(benchmark::State& state)
+    {
+        const auto input = make_input(1000000);
+        const char_set delims{",:"};
+        thread_pool pool{static_cast<size_t>(state.range(0))};
+        parallel_splitter splitter{pool};
+        std::vector<size_t> offsets;
+        for (auto _ : state)
+        {
+            splitter.split_offsets(input, delims, offsets);
+            benchmark::DoNotOptimize(offsets.data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * offsets.size());
+    }
+    BENCHMARK(BM_parallel_split_offsets)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+    // CSV with quoted fields, some of them with delimiters inside
+    std::string make_csv(int64_t records)
+    {
+        std::string result;
+        for (int64_t i = 0; i < records; ++i)
+        {
+            result += std::to_string(i) + ",\"Doe, John\",\"said \"\"hi\"\"\"," + std::to_string(i * 7 % 1000) + ",plain text field\n";
+        }
+        return result;
+    }
+
+    void BM_quoted_splitter(benchmark::State& state)
+    {
+        const auto input = make_csv(state.range(0));
+        csv_record record;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t fields = 0;
+            quoted_splitter splitter{input};
+            while (splitter.next(record))
+            {
+                fields += record.fields.size();
+            }
+            benchmark::DoNotOptimize(fields);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_quoted_splitter)->Arg(100)->Arg(100000);
+
+    // the same data through `read` into a 1 MB buffer, from a file (in the page cache after the first run)
+    void BM_chunked_record_reader(benchmark::State& state)
+    {
+        const auto input = make_csv(state.range(0));
+        char path[] = "/tmp/bench_csv_XXXXXX";
+        int fd = mkstemp(path);
+        write(fd, input.data(), input.size());
+        csv_record record;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            lseek(fd, 0, SEEK_SET);
+            size_t fields = 0;
+            chunked_record_reader reader{fd};
+            while (reader.next(record))
+            {
+                fields += record.fields.size();
+            }
+            benchmark::DoNotOptimize(fields);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        close(fd);
+        unlink(path);
+    }
+    BENCHMARK(BM_chunked_record_reader)->Arg(100000);
+
+    // log-like lines: "ts=1234 level=info msg=\"request 7 done\" user=u7 took=12ms"
+    std::string make_log(int64_t lines)
+    {
+        std::string result;
+        for (int64_t i = 0; i < lines; ++i)
+        {
+            result += "ts=" + std::to_string(1000000 + i) + " level=" + (i % 10 ? "info" : "warn") + " msg=\"request "
+                      + std::to_string(i) + " done\" user=u" + std::to_string(i % 97) + " took="
+                      + std::to_string(i * 13 % 500) + "ms\n";
+        }
+        return result;
+    }
+
+    template<typename RegexT, typename RangeT>
+    void match(benchmark::State& state, const std::string& input, const char* pattern)
+    {
+        const RegexT rx{pattern};
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& m : RangeT{rx, input})
+            {
+                n += m.length(m.size() - 1);
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+
+    void BM_regex_range(benchmark::State& state)
+    {
+        match<std::regex, regex_range>(state, make_input(state.range(0)), "\\d+:\\d+");
+    }
+    BENCHMARK(BM_regex_range)->Arg(10)->Arg(10000);
+
+    void BM_pike_regex_range(benchmark::State& state)
+    {
+        match<pike::regex, pike::regex_range>(state, make_input(state.range(0)), "\\d+:\\d+");
+    }
+    BENCHMARK(BM_pike_regex_range)->Arg(10)->Arg(10000);
+
+    // line by line, with the same `vm` for all of them
+    void BM_pike_regex_range_lines(benchmark::State& state)
+    {
+        std::vector<std::string> lines;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            lines.push_back(make_input(10));
+        }
+        const pike::regex rx_pair{"\\d+:\\d+"};
+        pike::vm matcher{rx_pair};
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& line : lines)
+            {
+                for (const auto& m : pike::regex_range{matcher, line})
+                {
+                    n += m.length();
+                }
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * lines.size() * lines[0].size());
+    }
+    BENCHMARK(BM_pike_regex_range_lines)->Arg(1000);
+
+    // submatches, alternation and a class which doesn't start with a rare byte
+    const char* key_value = "(\\w+)=(\"[^\"]*\"|\\S+)";
+
+    void BM_regex_range_key_value(benchmark::State& state)
+    {
+        match<std::regex, regex_range>(state, make_log(state.range(0)), key_value);
+    }
+    BENCHMARK(BM_regex_range_key_value)->Arg(1000);
+
+    void BM_pike_regex_range_key_value(benchmark::State& state)
+    {
+        match<pike::regex, pike::regex_range>(state, make_log(state.range(0)), key_value);
+    }
+    BENCHMARK(BM_pike_regex_range_key_value)->Arg(1000);
+
+    // a rare literal: most of the input is skipped by the prefilter
+    void BM_regex_range_rare(benchmark::State& state)
+    {
+        match<std::regex, regex_range>(state, make_log(state.range(0)), "level=(warn|error)");
+    }
+    BENCHMARK(BM_regex_range_rare)->Arg(1000);
+
+    void BM_pike_regex_range_rare(benchmark::State& state)
+    {
+        match<pike::regex, pike::regex_range>(state, make_log(state.range(0)), "level=(warn|error)");
+    }
+    BENCHMARK(BM_pike_regex_range_rare)->Arg(1000);
+
+    // the pattern is compiled with the program
+    template<rx::fixed_string Pattern>
+    void match_static(benchmark::State& state, const std::string& input)
+    {
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& m : rx::regex_range<Pattern>{input})
+            {
+                n += m.length(m.size() - 1);
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+
+    void BM_rx_regex_range(benchmark::State& state)
+    {
+        match_static<"\\d+:\\d+">(state, make_input(state.range(0)));
+    }
+    BENCHMARK(BM_rx_regex_range)->Arg(10)->Arg(10000);
+
+    void BM_rx_regex_range_key_value(benchmark::State& state)
+    {
+        match_static<"(\\w+)=(\"[^\"]*\"|\\S+)">(state, make_log(state.range(0)));
+    }
+    BENCHMARK(BM_rx_regex_range_key_value)->Arg(1000);
+
+    void BM_rx_regex_range_rare(benchmark::State& state)
+    {
+        match_static<"level=(warn|error)">(state, make_log(state.range(0)));
+    }
+    BENCHMARK(BM_rx_regex_range_rare)->Arg(1000);
+
+    // a dozen things to look for in a log, each pattern scanned separately or all of them at once
+    const std::vector<std::string> log_patterns = {
+        "level=warn", "took=4\\d\\dms", "user=u9[0-6] ", "request 99\\d", "ts=10001\\d7", "timeout",
+        "error", "msg=\"request 1\\d{3} ", "u13 ", "took=\\dms", "\\d+:\\d+", "done\" user=u4[2-5]",
+    };
+
+    void BM_regex_range_each_pattern(benchmark::State& state)
+    {
+        const auto input = make_log(state.range(0));
+        std::vector<std::regex> regexes(log_patterns.begin(), log_patterns.end());
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& rx : regexes)
+            {
+                for (const auto& m : regex_range{rx, input})
+                {
+                    n += m.length();
+                }
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_regex_range_each_pattern)->Arg(1000);
+
+    void BM_pike_regex_range_each_pattern(benchmark::State& state)
+    {
+        const auto input = make_log(state.range(0));
+        std::vector<pike::regex> regexes;
+        for (const auto& pattern : log_patterns)
+        {
+            regexes.emplace_back(pattern);
+        }
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& rx : regexes)
+            {
+                for (const auto& m : pike::regex_range{rx, input})
+                {
+                    n += m.length();
+                }
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_pike_regex_range_each_pattern)->Arg(1000);
+
+    void BM_multi_regex_range(benchmark::State& state)
+    {
+        const auto input = make_log(state.range(0));
+        const pike::multi_regex rx{log_patterns};
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& m : pike::multi_regex_range{rx, input})
+            {
+                n += m.text.size() + m.pattern;
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_multi_regex_range)->Arg(1000);
+
+    // the DFA is built once
+    void BM_multi_regex_range_reused(benchmark::State& state)
+    {
+        const auto input = make_log(state.range(0));
+        const pike::multi_regex rx{log_patterns};
+        pike::multi_vm matcher{rx};
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            size_t n = 0;
+            for (const auto& m : pike::multi_regex_range{matcher, input})
+            {
+                n += m.text.size() + m.pattern;
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_multi_regex_range_reused)->Arg(1000);
+}
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+#include "generators.h"
+
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+
+// Consuming a generator of CPU-heavy, uneven items: sequentially, by threads taking one item at a time
+// under a lock, and with `parallel_for_each` (batches and work stealing).
+namespace
+{
+    constexpr int items = 10000;
+
+    $generator(numbers, int(int)) {
+        int i;
+        $start;
+        for (i = 0; i < arg<0>(); ++i) {
+            $yield(i);
+        }
+        $stop;
+    };
+
+    // every 64th item is 50 times heavier
+    unsigned work(int n)
+    {
+        unsigned hash = n;
+        for (int i = 0, rounds = n % 64 == 0 ? 10000 : 200; i < rounds; ++i)
+        {
+            hash = hash * 2654435761u + 1;
+        }
+        return hash;
+    }
+
+    void BM_generator_sequential(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            unsigned sum = 0;
+            for (auto n : numbers{int{items}})
+            {
+                sum += work(n);
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * items);
+    }
+    BENCHMARK(BM_generator_sequential)->UseRealTime();
+
+    void BM_generator_shared_lock(benchmark::State& state)
+    {
+        thread_pool pool{size_t(state.range(0))};
+        for (auto _ : state)
+        {
+            std::atomic<unsigned> sum{0};
+            numbers gen{int{items}};
+            auto it = gen.begin();
+            std::mutex mutex;
+            pool.for_each_index(pool.size(), [&](size_t) {
+                for (;;)
+                {
+                    int n;
+                    {
+                        std::lock_guard lock{mutex};
+                        if (it == gen.end())
+                        {
+                            return;
+                        }
+                        n = *it;
+                        ++it;
+                    }
+                    sum += work(n);
+                }
+            });
+            benchmark::DoNotOptimize(sum.load());
+        }
+        state.SetItemsProcessed(state.iterations() * items);
+    }
+    BENCHMARK(BM_generator_shared_lock)->Arg(1)->Arg(4)->UseRealTime();
+
+    void BM_generator_parallel_for_each(benchmark::State& state)
+    {
+        thread_pool pool{size_t(state.range(0))};
+        for (auto _ : state)
+        {
+            std::atomic<unsigned> sum{0};
+            parallel_for_each(pool, numbers{int{items}}, [&](int n) { sum += work(n); });
+            benchmark::DoNotOptimize(sum.load());
+        }
+        state.SetItemsProcessed(state.iterations() * items);
+    }
+    BENCHMARK(BM_generator_parallel_for_each)->Arg(1)->Arg(4)->UseRealTime();
+
+    void BM_generator_parallel_for_each_ordered(benchmark::State& state)
+    {
+        thread_pool pool{size_t(state.range(0))};
+        for (auto _ : state)
+        {
+            unsigned sum = 0;
+            parallel_for_each_ordered(pool, numbers{int{items}}, work, [&](unsigned hash) { sum = sum * 31 + hash; });
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * items);
+    }
+    BENCHMARK(BM_generator_parallel_for_each_ordered)->Arg(1)->Arg(4)->UseRealTime();
+}
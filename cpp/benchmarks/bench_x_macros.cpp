@@ -0,0 +1,181 @@
+#include "x_macros.h"
+#include "alloc_counters.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string make_input(int64_t lines)
+    {
+        std::string result;
+        for (int64_t i = 0; i < lines; ++i)
+        {
+            result += "x" + std::to_string(i) + " = (alpha + " + std::to_string(i * 42) + ") * beta_ / ~gamma ? a : b\n";
+        }
+        return result;
+    }
+
+    template<typename LexerT>
+    void lex(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        size_t tokens = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            LexerT lexer{std::string{input}};
+            for (auto token = lexer.next(); token.type != TokType::Eof; token = lexer.next())
+            {
+                ++tokens;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(tokens);
+    }
+
+    void BM_scanf_lexer_next(benchmark::State& state)
+    {
+        lex<ScanfLexer>(state);
+    }
+    BENCHMARK(BM_scanf_lexer_next)->Arg(1)->Arg(100);
+
+    void BM_lexer_next(benchmark::State& state)
+    {
+        lex<Lexer>(state);
+    }
+    BENCHMARK(BM_lexer_next)->Arg(1)->Arg(100)->Arg(10000);
+
+    void BM_lexer_view_next(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        size_t tokens = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            LexerView lexer{input};
+            for (auto token = lexer.next(); token.type != TokType::Eof; token = lexer.next())
+            {
+                ++tokens;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(tokens);
+    }
+    BENCHMARK(BM_lexer_view_next)->Arg(1)->Arg(100)->Arg(10000);
+
+    // what a parser would do with `next()`: collecting the tokens, to compare with `tokenize_all`
+    void BM_lexer_view_collect(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        std::vector<TokenView> tokens;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            tokens.clear();
+            LexerView lexer{input};
+            for (auto token = lexer.next(); token.type != TokType::Eof; token = lexer.next())
+            {
+                tokens.push_back(token);
+            }
+            benchmark::DoNotOptimize(tokens.data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * tokens.size());
+    }
+    BENCHMARK(BM_lexer_view_collect)->Arg(1)->Arg(100)->Arg(10000);
+
+    void BM_tokenize_all(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        TokenBuffer buffer;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            tokenize_all(input, buffer);
+            benchmark::DoNotOptimize(buffer.types().data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * buffer.size());
+    }
+    BENCHMARK(BM_tokenize_all)->Arg(1)->Arg(100)->Arg(10000)->Arg(100000);
+
+    // Positions cost nothing while lexing, only when they're asked for. The worst case is asking for the position
+    // of the last token (e.g. an error at the end of file), which indexes all the lines; compare with `BM_tokenize_all`.
+    void BM_tokenize_all_last_position(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        TokenBuffer buffer;
+        size_t lines = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            tokenize_all(input, buffer);
+            SourceLines source_lines{input};
+            lines += source_lines.position(buffer.offsets().back()).line;
+        }
+        benchmark::DoNotOptimize(lines);
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * buffer.size());
+    }
+    BENCHMARK(BM_tokenize_all_last_position)->Arg(1)->Arg(100)->Arg(10000);
+
+    // the same, without lexing
+    void BM_line_index(benchmark::State& state)
+    {
+        const auto input = make_input(state.range(0));
+        size_t lines = 0;
+        for (auto _ : state)
+        {
+            SourceLines source_lines{input};
+            lines += source_lines.position(input.size() - 1).line;
+        }
+        benchmark::DoNotOptimize(lines);
+        state.SetBytesProcessed(state.iterations() * input.size());
+    }
+    BENCHMARK(BM_line_index)->Arg(10000);
+
+    // the parser consumes every chunk's tokens before the next one, so the buffer stays small
+    void BM_chunked_lexer(benchmark::State& state)
+    {
+        const auto input = make_input(10000);
+        const auto chunk_size = static_cast<size_t>(state.range(0));
+        TokenBuffer buffer;
+        size_t tokens = 0;
+        alloc_report report{state};
+        for (auto _ : state)
+        {
+            ChunkedLexer lexer;
+            for (size_t i = 0; i < input.size(); i += chunk_size)
+            {
+                buffer.clear();
+                lexer.feed(std::string_view{input}.substr(i, chunk_size), buffer);
+                tokens += buffer.size();
+            }
+            buffer.clear();
+            lexer.finish(buffer);
+            tokens += buffer.size();
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(tokens);
+    }
+    BENCHMARK(BM_chunked_lexer)->Arg(64)->Arg(4096)->Arg(65536);
+
+    // scaling with the number of threads (wall time: the work is done on the pool's threads);
+    // compare with `BM_tokenize_all/100000`
+    void BM_parallel_lexer(benchmark::State& state)
+    {
+        const auto input = make_input(100000);
+        thread_pool pool{static_cast<size_t>(state.range(0))};
+        ParallelLexer lexer{pool};
+        TokenBuffer buffer;
+        for (auto _ : state)
+        {
+            lexer.tokenize(input, buffer);
+            benchmark::DoNotOptimize(buffer.types().data());
+        }
+        state.SetBytesProcessed(state.iterations() * input.size());
+        state.SetItemsProcessed(state.iterations() * buffer.size());
+    }
+    BENCHMARK(BM_parallel_lexer)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+}
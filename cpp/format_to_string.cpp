@@ -1,236 +1,169 @@
-#include <type_traits>
-#include <string>
-#include <string_view>
+#include "format_to_string.h"
 
+// counting allocations to verify no more than one allocation per `concat`/`format` is done
+#define ALLOC_PROFILER_IMPLEMENTATION
+#include "alloc_profiler.h"
 
-namespace details
-{
-    // iteration over the variadic template arguments.
-    // Normal case:
-    template<typename FuncT, typename HeadT, typename... ArgsT>
-    void template_for_each(FuncT func, HeadT&& head, ArgsT&&... rest)
-    {
-        func(std::forward<HeadT>(head));
-        template_for_each(func, rest...);
-    }
+// simple test program
+#include <cstdio>
+#include <cassert>
 
-    // Terminating case:
-    template<typename FuncT>
-    void template_for_each(FuncT) {}
+struct Point {
+    int x, y;
+};
 
-    // This overload is optional: if it's not present, `strlen` is always called,
-    // which is usually OK, but... Why not avoid that if length is known at compile-time?
-    template<size_t N>
-    std::string_view to_string_view(const char (&s)[N])
+template<>
+struct formatter<Point> {
+    template<typename EmitT>
+    static void format(const Point& p, EmitT&& emit)
     {
-        // C-style arrays have terminating '\0' that we don't need.
-        return {s, N-1};
+        emit('('); emit(p.x); emit(", "); emit(p.y); emit(')');
     }
+};
 
-    // the template specification is crafted to force compiler to look at this overload
-    // *after* the previous one.
-    // (borrowed here https://android.googlesource.com/platform/external/qemu/+/emu-master-dev/android/android-emu-base/android/base/StringView.h#106)
-    template<typename CharT, typename = std::enable_if_t<std::is_same_v<CharT, char>>>
-    std::string_view to_string_view(const CharT* const &s)
+int main()
+{
+    using namespace std::literals;
+    alloc_profiler::scope allocs;
     {
-        return s;
-    }
-
-    // implementation for string and string_view are trivial:
-    template<typename = char>
-    std::string_view to_string_view(const std::string& s){
-        return s;
-    }
+        // using different kinds of literals here.
+        // We want to get a string long enough for SSO not to apply.
+        const char* bang = "!!!!";
+        const std::string hello = "Hello"s;
+        auto s = concat(hello," dear ", "world"sv, bang);
 
-    template<typename = char>
-    std::string_view to_string_view(const std::string_view& s){
-        return s;
+        std::fprintf(stderr, "%s\n", s.c_str());
     }
-}
 
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 1);
+    allocs.reset();
 
-// concatenate string-like arguments with no more than one allocation:
-template<typename... ArgsT>
-std::string concat(ArgsT&&... args)
-{
-    using namespace details;
-    // First, compute the total size of all strings combined:
-    size_t totalSize = 0;
-    template_for_each([&totalSize](auto&& arg) {
-            using ArgT = std::remove_reference_t<decltype(arg)>;
-            totalSize += to_string_view(std::forward<ArgT>(arg)).size();
-        }, std::forward<ArgsT>(args)...);
-
-    std::string result;
-    // ... and allocate enough memory (+1 byte for '\0')
-    result.reserve(totalSize + 1);
-
-    // then iterate again and append each argument to the accumulator
-    template_for_each([&result](auto&& arg) {
-        using ArgT = std::remove_reference_t<decltype(arg)>;
-        result += to_string_view(std::forward<ArgT>(arg));
-    }, std::forward<ArgsT>(args)...);
-
-    return result;
-}
-
-// Utilities for formatting
-namespace details
-{
-    struct marker_info {
-        std::string_view literal;
-        int arg_number;
-        std::string_view rest;
-    };
-
-    // this can be done a bit clearer with C++20, but I only have C++17 compiler installed right now
-    constexpr marker_info find_marker(const std::string_view& format)
     {
-        for (auto i = 0; i < format.size(); ++i)
-        {
-            if (format[i] == '%')
-            {
-                auto literal_end = i++;
-                auto c = format[i++];
-                if (c == '%')
-                {
-                    return { 
-                            format.substr(0, literal_end + 1), 
-                            -1,
-                            format.substr(i)
-                        };
-                }
-                else if ('0' <= c && c <= '9')
-                {
-                    return {
-                            format.substr(0, literal_end), 
-                            c - '0', 
-                            format.substr(i)
-                        };
-                }
-            }
-        }
-        return { format, -1, format.substr(0,0) };
+        // using different kinds of literals here.
+        // We want to get a string long enough for SSO not to apply.
+        const char* bang = "!!!!";
+        const std::string hello = "Hello"s;
+        auto s = format("- %0, %1 %3%2...", hello, "dear", bang, "world"sv);
+
+        std::fprintf(stderr, "%s\n", s.c_str());
     }
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 1);
+    allocs.reset();
 
-    template<typename Func>
-    constexpr void foreach_marker(std::string_view fmt, Func func)
     {
-        
-        while(!fmt.empty())
-        {
-            auto [ literal, arg_number, rest ] = find_marker(fmt);
-            func(literal, arg_number);
-            fmt = rest;
-        }
+        // same thing, but the format string is parsed by compiler.
+        const char* bang = "!!!!";
+        const std::string hello = "Hello"s;
+        auto s = format<"- %0, %1 %3%2...">(hello, "dear", bang, "world"sv);
+
+        std::fprintf(stderr, "%s\n", s.c_str());
+        assert(s == format("- %0, %1 %3%2...", hello, "dear", bang, "world"sv));
+        assert(format<"100%% %0%">("sure") == "100% sure%");  // short enough for SSO
+        // this won't compile - there's no `%4`:
+        // format<"%4">(hello, "dear", bang, "world"sv);
     }
-    
-    template<int N>
-    std::string_view nth(int) {
-        return "";
-    }    
-
-    template<int N = 0, typename ArgT, typename... ArgsT>
-    std::string_view nth(int i, ArgT&& arg, ArgsT&&... args)
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 2);
+    allocs.reset();
+
     {
-        if (i == N)
+        // reusing the buffer: once it's warmed up, there're no allocations at all.
+        const std::string hello = "Hello"s;
+        std::string buffer;
+        buffer.reserve(100);
+        allocs.reset();
+        for (int i = 0; i < 100; ++i)
         {
-            return to_string_view(std::forward<ArgT>(arg));
+            buffer.clear();
+            concat_append(buffer, hello, " dear ", "world"sv, "!!!!");
+            format_append(buffer, " - %0, %1 %2", hello, "dear", "world"sv);
+            format_append<" - %0, %1 %2">(buffer, hello, "dear", "world"sv);
         }
-        return nth<N+1, ArgsT...>(i, std::forward<ArgsT>(args)...);
+        std::fprintf(stderr, "%s\n", buffer.c_str());
+        assert(allocs.allocations() == 0);
+
+        // fixed buffer on stack
+        char buf[16];
+        auto [end, size] = format_to_n(buf, sizeof(buf), "- %0, %1 %2", hello, "dear", "world"sv);
+        assert(size == 19 && end == buf + sizeof(buf)); // truncated
+        assert(std::string_view(buf, sizeof(buf)) == "- Hello, dear wo");
+
+        auto end2 = format_to<"%0, %1!">(buf, hello, "world"sv);
+        assert(std::string_view(buf, end2 - buf) == "Hello, world!");
+        auto [end3, size3] = concat_to_n(buf, sizeof(buf), hello, "!");
+        assert(size3 == 6 && std::string_view(buf, end3 - buf) == "Hello!");
+        assert(concat_to(buf, "ab", "cd"sv) == buf + 4);
     }
-}
-
-// Simple formatting facility - replaces markers `%0`..`%9` with corresponding string-ish arguments.
-// Doesn't do any advanced validation (but it's not hard to implement one).
-// Only allocates memory once.
-template<typename... ArgsT>
-std::string format(const std::string_view& fmt, ArgsT&&... args)
-{
-    using namespace details;
-    // compute length of all the strings, including substitutions.
-    size_t total_length = 0;
-    foreach_marker(fmt, [&total_length, &args...](auto&& s, int arg_id) {
-        total_length += s.size();
-        if (arg_id >= 0)
-        {
-            total_length += nth(arg_id, std::forward<ArgsT>(args)...).size();
-        }
-    });
+    assert(allocs.allocations() == 0);
+    assert(allocs.frees() == 1);
+    allocs.reset();
 
-    std::string result;
-    result.reserve(total_length);
-
-    // concatenate
-    foreach_marker(fmt, [&result, &args...](auto&& s, int arg_id) {
-        result.append(s);
-        if (arg_id >= 0)
-        {
-            result.append(nth(arg_id, std::forward<ArgsT>(args)...));
-        }
-    });
-
-    return result;
-}
-
-// overriding new/delete to verify no more than one allocation per `concat`/`format` is done
-#include <cstdlib>
-
-static int alloc_count = 0;
-static int free_count = 0;
-
-void* operator new(size_t sz)
-{
-    alloc_count++;
-    return std::malloc(sz);
-}
-void* operator new[](size_t sz)
-{
-    alloc_count++;
-    return std::malloc(sz);
-}
-
-void operator delete(void* p)
-{
-    free_count++;
-    std::free(p);
-}
-void operator delete[](void* p)
-{
-    free_count++;
-    std::free(p);
-}
+    {
+        // numbers and user types are formatted without temporary strings, too.
+        auto s = concat("answer=", 42, ", pi~", 3.14, ", tiny=", 1e-300, ", ok=", true, ", at ", Point{-1, 2});
+        std::fprintf(stderr, "%s\n", s.c_str());
+        assert(s == "answer=42, pi~3.14, tiny=1e-300, ok=true, at (-1, 2)");
 
-// simple test program
-#include <cstdio>
-#include <cassert>
+        auto s2 = format<"%0 + %1 = %2 (%3)">(0.1f, 0.2, 0.1f + 0.2, 'x');
+        std::fprintf(stderr, "%s\n", s2.c_str());
+        assert(s2 == "0.1 + 0.2 = 0.30000000149011613 (x)");
+        assert(s2 == format("%0 + %1 = %2 (%3)", 0.1f, 0.2, 0.1f + 0.2, 'x'));
+    }
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 3);
+    allocs.reset();
 
-int main()
-{
-    using namespace std::literals;
     {
-        // using different kinds of literals here.
-        // We want to get a string long enough for SSO not to apply.
-        const char* bang = "!!!!";
-        const std::string hello = "Hello"s;
-        auto s = concat(hello," dear ", "world"sv, bang);
+        // format specs: padding is computed in the length pass, so there's still one allocation.
+        auto s = format<"|%{0:>6}|%{1:<4}|%{2:^7}|%{3:>10}|">("ab", 7, "mid", Point{1, 2});
+        std::fprintf(stderr, "%s\n", s.c_str());
+        assert(s == "|    ab|7   |  mid  |    (1, 2)|");
+
+        auto s2 = format("%{0:x} %{0:X} %{1:08b} %{2:*^9.3f} %{3:.3} %{4:06} %{5:.2e}",
+                         255, 10, 3.14159, "truncated", -42, 12345.678);
+        std::fprintf(stderr, "%s\n", s2.c_str());
+        assert(s2 == "ff FF 00001010 **3.142** tru -00042 1.23e+04");
+        assert(s2 == (format<"%{0:x} %{0:X} %{1:08b} %{2:*^9.3f} %{3:.3} %{4:06} %{5:.2e}">(
+                         255, 10, 3.14159, "truncated", -42, 12345.678)));
+        // malformed markers are left as is
+        assert(format("%{a} %{0:?} %{0", 1) == "%{a} %{0:?} %{0");
+    }
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 3);
+    allocs.reset();
 
+    {
+        // more than 10 arguments: `%{N}` takes any number of digits (`%10` is still `%1` followed by `0`)
+        auto s = format("%{12}|%{11}|%{10}|%10|%{12:>4}|%{13}|", 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, "ten", 11, 12.5);
         std::fprintf(stderr, "%s\n", s.c_str());
+        assert(s == "12.5|11|ten|10|12.5||");
+        assert(s == (format<"%{12}|%{11}|%{10}|%10|%{12:>4}||">(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, "ten", 11, 12.5)));
     }
+    assert(allocs.allocations() == allocs.frees());
+    assert(allocs.allocations() == 2);
 
-    assert(alloc_count == free_count);
-    assert(alloc_count == 1);
-    alloc_count = free_count = 0;
+    // too big widths and precisions make a marker malformed too (format strings may come from config files)
+    assert(format("%{0:9999999999}|%{0:.5000}|%{0:4096}", 1).substr(0, 29) == "%{0:9999999999}|%{0:.5000}|  ");
+    // and huge argument numbers just refer to missing arguments
+    assert(format("%{99999999999}|%{99999999999:>4}|%{0}", 1) == "||1");
 
     {
-        // using different kinds of literals here.
-        // We want to get a string long enough for SSO not to apply.
-        const char* bang = "!!!!";
-        const std::string hello = "Hello"s;
-        auto s = format("- %0, %1 %3%2...", hello, "dear", bang, "world"sv);
-
-        std::fprintf(stderr, "%s\n", s.c_str());
+        // vectorized search finds the same thing as the plain loop, wherever the marker is
+        char text[100];
+        for (size_t pos = 0; pos <= sizeof(text); ++pos)
+        {
+            std::fill(std::begin(text), std::end(text), 'a');
+            if (pos < sizeof(text))
+            {
+                text[pos] = '%';
+            }
+            for (size_t from = 0; from < sizeof(text); from += 7)
+            {
+                std::string_view sv{text, sizeof(text)};
+                assert(details::find_char_simd(sv, from, '%') == details::find_char_scalar(sv, from, '%'));
+            }
+        }
     }
-    assert(alloc_count == free_count);
-    assert(alloc_count == 1);
 }
\ No newline at end of file
@@ -0,0 +1,888 @@
+#pragma once
+
+#include <type_traits>
+#include <string>
+#include <string_view>
+#include <charconv>
+
+
+namespace details
+{
+    // iteration over the variadic template arguments.
+    // Terminating case (needs to be declared first, so that the normal case can see it):
+    template<typename FuncT>
+    void template_for_each(FuncT) {}
+
+    // Normal case:
+    template<typename FuncT, typename HeadT, typename... ArgsT>
+    void template_for_each(FuncT func, HeadT&& head, ArgsT&&... rest)
+    {
+        func(std::forward<HeadT>(head));
+        template_for_each(func, rest...);
+    }
+
+    // This overload is optional: if it's not present, `strlen` is always called,
+    // which is usually OK, but... Why not avoid that if length is known at compile-time?
+    template<size_t N>
+    std::string_view to_string_view(const char (&s)[N])
+    {
+        // C-style arrays have terminating '\0' that we don't need.
+        return {s, N-1};
+    }
+
+    // the template specification is crafted to force compiler to look at this overload
+    // *after* the previous one.
+    // (borrowed here https://android.googlesource.com/platform/external/qemu/+/emu-master-dev/android/android-emu-base/android/base/StringView.h#106)
+    template<typename CharT, typename = std::enable_if_t<std::is_same_v<CharT, char>>>
+    std::string_view to_string_view(const CharT* const &s)
+    {
+        return s;
+    }
+
+    // implementation for string and string_view are trivial:
+    template<typename = char>
+    std::string_view to_string_view(const std::string& s){
+        return s;
+    }
+
+    template<typename = char>
+    std::string_view to_string_view(const std::string_view& s){
+        return s;
+    }
+}
+
+// Opt-in formatting for user types: specialize `formatter` with a static `format` function
+// that "emits" parts of the value (strings, numbers, or anything else that can be formatted):
+//
+//  template<> struct formatter<Point> {
+//      template<typename EmitT>
+//      static void format(const Point& p, EmitT&& emit) {
+//          emit("("); emit(p.x); emit(", "); emit(p.y); emit(")");
+//      }
+//  };
+//
+// It's called once per pass, so it shouldn't have side effects.
+template<typename T>
+struct formatter;
+
+namespace details
+{
+    // sinks receive the output piece by piece. This one only counts the length
+    // (more of them below).
+    struct length_sink {
+        size_t size = 0;
+        void operator()(std::string_view s) { size += s.size(); }
+    };
+
+    template<typename T>
+    concept string_like = requires(const T& value) { to_string_view(value); };
+
+    template<typename T>
+    concept user_formattable = requires { sizeof(formatter<T>); };
+
+    // What can be put after ':' in a `%{N:spec}` marker:
+    //  `[[fill]align][0][width][.precision][type]`
+    // where `align` is `<`, `>` or `^` (by default, strings are aligned left and numbers right),
+    // `0` pads numbers with zeros after the sign,
+    // `precision` is a number of digits for floating-point numbers or max length for strings,
+    // and `type` is `x`, `X`, `o` or `b` for integers, or `e`, `f`, `g`, `a` (or uppercase) for floating-point.
+    struct format_spec {
+        char fill = ' ';
+        char align = '\0';
+        bool zero_pad = false;
+        int width = 0;
+        int precision = -1;
+        char type = '\0';
+    };
+
+    constexpr bool is_digit(char c) { return '0' <= c && c <= '9'; }
+    constexpr bool is_align(char c) { return c == '<' || c == '>' || c == '^'; }
+
+    // Format strings may come from config files: bigger widths are most likely mistakes
+    // (and would allocate that much padding).
+    constexpr int max_width = 4096;
+
+    // returns `false` if it's not a valid spec
+    constexpr bool parse_spec(std::string_view s, format_spec& spec)
+    {
+        size_t i = 0;
+        if (s.size() >= 2 && is_align(s[1]))
+        {
+            spec.fill = s[0];
+            spec.align = s[1];
+            i = 2;
+        }
+        else if (!s.empty() && is_align(s[0]))
+        {
+            spec.align = s[0];
+            i = 1;
+        }
+        if (i < s.size() && s[i] == '0')
+        {
+            spec.zero_pad = true;
+            ++i;
+        }
+        for (; i < s.size() && is_digit(s[i]); ++i)
+        {
+            spec.width = spec.width * 10 + (s[i] - '0');
+            if (spec.width > max_width)
+            {
+                return false;
+            }
+        }
+        if (i < s.size() && s[i] == '.')
+        {
+            spec.precision = 0;
+            for (++i; i < s.size() && is_digit(s[i]); ++i)
+            {
+                spec.precision = spec.precision * 10 + (s[i] - '0');
+                if (spec.precision > max_width)
+                {
+                    return false;
+                }
+            }
+        }
+        if (i < s.size() && std::string_view{"xXobeEfFgGaA"}.find(s[i]) != std::string_view::npos)
+        {
+            spec.type = s[i++];
+        }
+        return i == s.size();
+    }
+
+    // enough for any integer in any base and shortest round-trip representation of any floating-point number,
+    // and also for any `double` in fixed notation with precision up to `max_precision`.
+    constexpr size_t scalar_buffer_size = 400;
+    constexpr int max_precision = 64;
+
+    template<typename T>
+    std::string_view render_number(char (&buf)[scalar_buffer_size], T value, const format_spec& spec)
+    {
+        std::to_chars_result result;
+        if constexpr (std::is_integral_v<T>)
+        {
+            int base = 10;
+            switch (spec.type)
+            {
+            case 'x': case 'X': base = 16; break;
+            case 'o': base = 8; break;
+            case 'b': base = 2; break;
+            }
+            result = std::to_chars(buf, buf + sizeof(buf), value, base);
+        }
+        else
+        {
+            // without format, `to_chars` gives shortest round-trip representation.
+            auto precision = spec.precision < max_precision ? spec.precision : max_precision;
+            std::chars_format fmt = std::chars_format::general;
+            switch (spec.type)
+            {
+            case 'e': case 'E': fmt = std::chars_format::scientific; break;
+            case 'f': case 'F': fmt = std::chars_format::fixed; break;
+            case 'a': case 'A': fmt = std::chars_format::hex; break;
+            }
+            if (precision >= 0)
+            {
+                result = std::to_chars(buf, buf + sizeof(buf), value, fmt, precision);
+            }
+            else if (spec.type)
+            {
+                result = std::to_chars(buf, buf + sizeof(buf), value, fmt);
+            }
+            else
+            {
+                result = std::to_chars(buf, buf + sizeof(buf), value);
+            }
+            // huge `long double` in fixed notation may not fit, fall back to scientific.
+            if (result.ec != std::errc{})
+            {
+                result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific);
+            }
+        }
+        if ('A' <= spec.type && spec.type <= 'Z')
+        {
+            for (auto p = buf; p != result.ptr; ++p)
+            {
+                *p = ('a' <= *p && *p <= 'z') ? *p - 'a' + 'A' : *p;
+            }
+        }
+        return {buf, static_cast<size_t>(result.ptr - buf)};
+    }
+
+    template<typename SinkT>
+    void write_fill(SinkT& sink, char c, size_t count)
+    {
+        char buf[32];
+        std::fill(std::begin(buf), std::end(buf), c);
+        while (count > 0)
+        {
+            auto n = count < sizeof(buf) ? count : sizeof(buf);
+            sink(std::string_view{buf, n});
+            count -= n;
+        }
+    }
+
+    // padding is written through the sink as well, so it's counted in the length pass.
+    template<typename SinkT, typename WriteFuncT>
+    void write_padded(SinkT& sink, size_t size, const format_spec& spec, char default_align, WriteFuncT write)
+    {
+        auto padding = spec.width > static_cast<int>(size) ? spec.width - size : 0;
+        auto align = spec.align ? spec.align : default_align;
+        auto before = align == '<' ? 0 : align == '^' ? padding / 2 : padding;
+        write_fill(sink, spec.fill, before);
+        write(sink);
+        write_fill(sink, spec.fill, padding - before);
+    }
+
+    template<typename SinkT>
+    void write_padded(SinkT& sink, std::string_view s, const format_spec& spec, char default_align = '<')
+    {
+        write_padded(sink, s.size(), spec, default_align, [s](auto& sink) { sink(s); });
+    }
+
+    // Numbers are rendered into a buffer on stack and then passed to the sink as any other string.
+    // So there're no temporary `std::string`s, and their size is counted in the same length pass.
+    // Note that `signed char` and `unsigned char` are numbers, and only `char` is a character
+    // (unless it has an integer `type` in its spec).
+    template<typename SinkT, typename T>
+    void format_value(SinkT& sink, const T& value, const format_spec& spec = {})
+    {
+        if constexpr (string_like<T>)
+        {
+            auto s = to_string_view(value);
+            write_padded(sink, spec.precision >= 0 ? s.substr(0, spec.precision) : s, spec);
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            write_padded(sink, value ? std::string_view{"true"} : std::string_view{"false"}, spec);
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            if (spec.type)
+            {
+                format_value(sink, static_cast<int>(value), spec);
+            }
+            else
+            {
+                write_padded(sink, std::string_view{&value, 1}, spec);
+            }
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            char buf[scalar_buffer_size];
+            auto s = render_number(buf, value, spec);
+            if (spec.zero_pad && !spec.align)
+            {
+                // zeros go after the sign
+                format_spec zeros = spec;
+                zeros.fill = '0';
+                auto sign = s.substr(0, s.size() && s[0] == '-' ? 1 : 0);
+                sink(sign);
+                zeros.width -= static_cast<int>(sign.size());
+                write_padded(sink, s.substr(sign.size()), zeros, '>');
+            }
+            else
+            {
+                write_padded(sink, s, spec, '>');
+            }
+        }
+        else
+        {
+            static_assert(user_formattable<T>, "the type is neither string-like nor a number, `formatter` needs to be specialized for it");
+            auto write = [&value](auto& sink) {
+                formatter<T>::format(value, [&sink](const auto& part) { format_value(sink, part); });
+            };
+            if (spec.width > 0)
+            {
+                // user types have to be measured first.
+                length_sink length;
+                write(length);
+                write_padded(sink, length.size, spec, '<', write);
+            }
+            else
+            {
+                write(sink);
+            }
+        }
+    }
+}
+
+
+// Both `concat` and `format` are implemented as two passes over the same pieces:
+// one computes the length, another one copies the data.
+// Pieces are fed to a "sink", so the same code can write into a new string,
+// append to an existing one, or write through an output iterator.
+#include <algorithm>
+#include <array>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace details
+{
+    struct append_sink {
+        std::string& result;
+        void operator()(std::string_view s) { result.append(s); }
+    };
+
+    template<typename OutputIt>
+    struct iterator_sink {
+        OutputIt out;
+        void operator()(std::string_view s) { out = std::copy(s.begin(), s.end(), out); }
+    };
+
+    // writes no more than `capacity` chars, but keeps counting the size after that.
+    template<typename OutputIt>
+    struct bounded_sink {
+        OutputIt out;
+        size_t capacity;
+        size_t size = 0;
+        void operator()(std::string_view s)
+        {
+            if (size < capacity)
+            {
+                out = std::copy_n(s.begin(), std::min(s.size(), capacity - size), out);
+            }
+            size += s.size();
+        }
+    };
+
+    // reserves the memory in advance, so there's no more than one allocation
+    // (and none at all if `result` already has enough capacity).
+    template<typename WriteFuncT>
+    void append_with_reserve(std::string& result, WriteFuncT write)
+    {
+        length_sink length;
+        write(length);
+        result.reserve(result.size() + length.size);
+        append_sink append{result};
+        write(append);
+    }
+
+    // Type-erased reference to a sink.
+    // Only used for the rare cases when an argument has to be formatted through `format_arg::format`.
+    struct sink_ref {
+        void* sink;
+        void (*put)(void* sink, std::string_view s);
+
+        template<typename SinkT>
+        sink_ref(SinkT& s)
+        : sink{&s}, put{[](void* sink, std::string_view s) { (*static_cast<SinkT*>(sink))(s); }}
+        {}
+
+        void operator()(std::string_view s) const { put(sink, s); }
+    };
+
+    // Every argument is converted once, up front, into a table of these.
+    // Markers then just index the table, no matter how many arguments there are,
+    // or how many times an argument is referenced.
+    struct format_arg {
+        // strings, `bool`s, `char`s and numbers (rendered into `buf`)
+        std::string_view text;
+        char default_align = '<';
+        bool has_text = false;
+        // numbers with format spec that changes the digits, and user types, are formatted on the fly:
+        const void* value = nullptr;
+        void (*format)(sink_ref sink, const void* value, const format_spec& spec) = nullptr;
+        // enough for any integer in base 10 or shortest representation of any floating-point number
+        char buf[40];
+    };
+
+    template<typename T>
+    void format_erased(sink_ref sink, const void* value, const format_spec& spec)
+    {
+        format_value(sink, *static_cast<const T*>(value), spec);
+    }
+
+    template<typename T>
+    void resolve_arg(format_arg& arg, const T& value)
+    {
+        if constexpr (string_like<T>)
+        {
+            arg.text = to_string_view(value);
+            arg.has_text = true;
+            return;
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            arg.text = value ? std::string_view{"true"} : std::string_view{"false"};
+            arg.has_text = true;
+            return;
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            arg.text = {&value, 1};
+            arg.has_text = true;
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            arg.default_align = '>';
+            auto [end, ec] = std::to_chars(arg.buf, arg.buf + sizeof(arg.buf), value);
+            arg.text = {arg.buf, static_cast<size_t>(end - arg.buf)};
+            arg.has_text = ec == std::errc{};
+        }
+        arg.value = &value;
+        arg.format = &format_erased<T>;
+    }
+
+    template<typename... ArgsT>
+    using format_args = std::array<format_arg, sizeof...(ArgsT)>;
+
+    template<typename... ArgsT>
+    void resolve_args(format_args<ArgsT...>& table, ArgsT&&... args)
+    {
+        size_t i = 0;
+        template_for_each([&table, &i](auto&& arg) {
+            resolve_arg(table[i++], arg);
+        }, std::forward<ArgsT>(args)...);
+    }
+
+    // spec that only adds padding can be applied to the text we already have.
+    constexpr bool changes_text(const format_spec& spec)
+    {
+        return spec.type || spec.precision >= 0 || spec.zero_pad;
+    }
+
+    template<typename SinkT>
+    void format_arg_into(SinkT& sink, const format_arg& arg, const format_spec& spec)
+    {
+        if (!arg.format)
+        {
+            write_padded(sink, spec.precision >= 0 ? arg.text.substr(0, spec.precision) : arg.text, spec);
+        }
+        else if (arg.has_text && !changes_text(spec))
+        {
+            write_padded(sink, arg.text, spec, arg.default_align);
+        }
+        else
+        {
+            arg.format(sink, arg.value, spec);
+        }
+    }
+
+    template<typename SinkT, size_t N>
+    void concat_into(SinkT& sink, const std::array<format_arg, N>& args)
+    {
+        for (const auto& arg : args)
+        {
+            format_arg_into(sink, arg, {});
+        }
+    }
+}
+
+// same as `std::format_to_n_result`: `size` is the full length of the output,
+// if it's bigger than the buffer size, the output was truncated.
+template<typename OutputIt>
+struct format_to_n_result {
+    OutputIt out;
+    size_t size;
+};
+
+// concatenate string-like arguments (or numbers, or types with `formatter`) with no more than one allocation:
+template<typename... ArgsT>
+std::string concat(ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    std::string result;
+    details::append_with_reserve(result, [&table](auto& sink) {
+        details::concat_into(sink, table);
+    });
+    return result;
+}
+
+// append to existing string. Once `result` has enough capacity, doesn't allocate at all.
+template<typename... ArgsT>
+void concat_append(std::string& result, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::append_with_reserve(result, [&table](auto& sink) {
+        details::concat_into(sink, table);
+    });
+}
+
+// write through output iterator (e.g. into a `char` buffer known to be large enough, or a `back_inserter`)
+template<typename OutputIt, typename... ArgsT>
+OutputIt concat_to(OutputIt out, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::iterator_sink<OutputIt> sink{out};
+    details::concat_into(sink, table);
+    return sink.out;
+}
+
+// write no more than `n` chars (e.g. into a fixed stack buffer). Note that '\0' is not appended.
+template<typename OutputIt, typename... ArgsT>
+format_to_n_result<OutputIt> concat_to_n(OutputIt out, size_t n, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::bounded_sink<OutputIt> sink{out, n};
+    details::concat_into(sink, table);
+    return {sink.out, sink.size};
+}
+
+// Utilities for formatting
+namespace details
+{
+    struct marker_info {
+        std::string_view literal;
+        int arg_number;
+        format_spec spec;
+        std::string_view rest;
+    };
+
+    // more than any argument list can have: bigger numbers are kept at that, still referring to a missing argument
+    constexpr int max_arg_number = 1 << 20;
+
+    // the inside of `%{N}` or `%{N:spec}`. Unlike `%N`, `N` can have more than one digit.
+    constexpr bool parse_marker(std::string_view s, int& arg_number, format_spec& spec)
+    {
+        size_t i = 0;
+        arg_number = 0;
+        for (; i < s.size() && is_digit(s[i]); ++i)
+        {
+            arg_number = std::min(arg_number * 10 + (s[i] - '0'), max_arg_number);
+        }
+        if (i == 0 || (i < s.size() && s[i] != ':'))
+        {
+            return false;
+        }
+        return i == s.size() || parse_spec(s.substr(i + 1), spec);
+    }
+
+    // Format strings loaded at runtime (e.g. from config) are mostly long literal text,
+    // so it pays off to skip it 16 or 32 bytes at a time.
+    // Returns `s.size()` if there's no `c`.
+    constexpr size_t find_char_scalar(std::string_view s, size_t from, char c)
+    {
+        for (; from < s.size(); ++from)
+        {
+            if (s[from] == c)
+            {
+                return from;
+            }
+        }
+        return s.size();
+    }
+
+    inline int count_trailing_zeros(unsigned mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // SSE2 is always there on x86-64; AVX2 is used if enabled at build time (e.g. `-mavx2` or `-march=native`).
+    inline size_t find_char_simd(std::string_view s, size_t from, char c)
+    {
+        auto p = s.data() + from;
+        const auto end = s.data() + s.size();
+#if defined(__AVX2__)
+        const __m256i needle32 = _mm256_set1_epi8(c);
+        for (; end - p >= 32; p += 32)
+        {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32)));
+            if (mask)
+            {
+                return (p - s.data()) + count_trailing_zeros(mask);
+            }
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i needle16 = _mm_set1_epi8(c);
+        for (; end - p >= 16; p += 16)
+        {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16)));
+            if (mask)
+            {
+                return (p - s.data()) + count_trailing_zeros(mask);
+            }
+        }
+#endif
+        return find_char_scalar(s, p - s.data(), c);
+    }
+
+    // compiler can't run intrinsics, so compile-time parsing uses the plain loop.
+    constexpr size_t find_char(std::string_view s, size_t from, char c)
+    {
+        if (std::is_constant_evaluated())
+        {
+            return find_char_scalar(s, from, c);
+        }
+        return find_char_simd(s, from, c);
+    }
+
+    // this can be done a bit clearer with C++20, but I only have C++17 compiler installed right now
+    // (the compile-time version of `format` below does use C++20 though).
+    // Note that a lone '%' at the very end or '%' followed by something else
+    // (including malformed `%{...}`) is kept as is.
+    constexpr marker_info find_marker(const std::string_view& format)
+    {
+        for (size_t i = find_char(format, 0, '%'); i + 1 < format.size(); i = find_char(format, i + 1, '%'))
+        {
+            auto c = format[i + 1];
+            if (c == '%')
+            {
+                return { 
+                        format.substr(0, i + 1), 
+                        -1,
+                        {},
+                        format.substr(i + 2)
+                    };
+            }
+            else if (is_digit(c))
+            {
+                return {
+                        format.substr(0, i), 
+                        c - '0', 
+                        {},
+                        format.substr(i + 2)
+                    };
+            }
+            else if (c == '{')
+            {
+                auto close = format.find('}', i + 2);
+                marker_info marker{ format.substr(0, i), -1, {}, {} };
+                if (close != std::string_view::npos
+                    && parse_marker(format.substr(i + 2, close - i - 2), marker.arg_number, marker.spec))
+                {
+                    marker.rest = format.substr(close + 1);
+                    return marker;
+                }
+            }
+        }
+        return { format, -1, {}, format.substr(0,0) };
+    }
+
+    template<typename Func>
+    constexpr void foreach_marker(std::string_view fmt, Func func)
+    {
+        
+        while(!fmt.empty())
+        {
+            auto [ literal, arg_number, spec, rest ] = find_marker(fmt);
+            func(literal, arg_number, spec);
+            fmt = rest;
+        }
+    }
+}
+
+namespace details
+{
+    template<typename SinkT, size_t N>
+    void format_into(SinkT& sink, std::string_view fmt, const std::array<format_arg, N>& args)
+    {
+        foreach_marker(fmt, [&sink, &args](auto&& s, int arg_id, const format_spec& spec) {
+            sink(s);
+            // references to missing arguments produce nothing
+            if (arg_id >= 0 && static_cast<size_t>(arg_id) < N)
+            {
+                format_arg_into(sink, args[arg_id], spec);
+            }
+        });
+    }
+}
+
+// Simple formatting facility - replaces markers `%0`..`%9` with corresponding arguments
+// (strings, numbers, or types with `formatter`).
+// Markers can also have format spec, e.g. `%{0:>8}` or `%{1:08.3f}` (see `format_spec` above).
+// Doesn't do any advanced validation (but it's not hard to implement one).
+// Only allocates memory once.
+template<typename... ArgsT>
+std::string format(const std::string_view& fmt, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    std::string result;
+    details::append_with_reserve(result, [&fmt, &table](auto& sink) {
+        details::format_into(sink, fmt, table);
+    });
+    return result;
+}
+
+// The same variants as for `concat`:
+template<typename... ArgsT>
+void format_append(std::string& result, const std::string_view& fmt, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::append_with_reserve(result, [&fmt, &table](auto& sink) {
+        details::format_into(sink, fmt, table);
+    });
+}
+
+template<typename OutputIt, typename... ArgsT>
+OutputIt format_to(OutputIt out, const std::string_view& fmt, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::iterator_sink<OutputIt> sink{out};
+    details::format_into(sink, fmt, table);
+    return sink.out;
+}
+
+template<typename OutputIt, typename... ArgsT>
+format_to_n_result<OutputIt> format_to_n(OutputIt out, size_t n, const std::string_view& fmt, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::bounded_sink<OutputIt> sink{out, n};
+    details::format_into(sink, fmt, table);
+    return {sink.out, sink.size};
+}
+
+// Compile-time parsed formatting.
+// The `format` above scans the format string twice, looking for markers.
+// When the format string is a literal, compiler can do all of that instead:
+// the string is split into a fixed sequence of (literal, argument index) pieces,
+// so both passes become straight-line code with indices known in advance.
+// As a bonus, referring to a missing argument is a compilation error.
+// Needs C++20 to pass a string literal as a template argument.
+#include <array>
+#include <tuple>
+#include <utility>
+
+namespace details
+{
+    // a string literal wrapper that can be a template argument.
+    template<size_t N>
+    struct fixed_string
+    {
+        char data[N]{};
+
+        constexpr fixed_string(const char (&s)[N])
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                data[i] = s[i];
+            }
+        }
+
+        constexpr std::string_view view() const
+        {
+            return {data, N - 1};
+        }
+    };
+
+    struct format_piece {
+        std::string_view literal;
+        int arg_number;
+        format_spec spec;
+    };
+
+    // all the parsing is done once per format string, by compiler.
+    template<fixed_string Fmt>
+    struct parsed_format
+    {
+        static constexpr size_t size = [] {
+            size_t n = 0;
+            foreach_marker(Fmt.view(), [&n](auto&&...) { ++n; });
+            return n;
+        }();
+
+        static constexpr std::array<format_piece, size> pieces = [] {
+            std::array<format_piece, size> result{};
+            size_t n = 0;
+            foreach_marker(Fmt.view(), [&](std::string_view literal, int arg_number, const format_spec& spec) {
+                result[n++] = { literal, arg_number, spec };
+            });
+            return result;
+        }();
+
+        static constexpr int max_arg = [] {
+            int result = -1;
+            for (auto& piece : pieces)
+            {
+                result = piece.arg_number > result ? piece.arg_number : result;
+            }
+            return result;
+        }();
+    };
+
+    // argument indices and specs are constants here.
+    template<typename ParsedT, size_t I, typename SinkT, typename TupleT, size_t N>
+    void format_piece_into(SinkT& sink, const std::array<format_arg, N>& args, const TupleT& refs)
+    {
+        constexpr auto piece = ParsedT::pieces[I];
+        sink(piece.literal);
+        if constexpr (piece.arg_number < 0)
+        {
+            return;
+        }
+        else if constexpr (changes_text(piece.spec))
+        {
+            // the type is known here, so there's no need to go through `format_arg::format`
+            format_value(sink, std::get<piece.arg_number>(refs), piece.spec);
+        }
+        else
+        {
+            format_arg_into(sink, args[piece.arg_number], piece.spec);
+        }
+    }
+
+    // `pieces` are known to compiler, so the fold below is unrolled into straight-line code.
+    template<fixed_string Fmt, typename SinkT, typename TupleT, size_t N>
+    void format_into(SinkT& sink, const std::array<format_arg, N>& args, const TupleT& refs)
+    {
+        using parsed = parsed_format<Fmt>;
+        static_assert(parsed::max_arg < static_cast<int>(N), "format string refers to a missing argument");
+
+        [&sink, &args, &refs]<size_t... I>(std::index_sequence<I...>) {
+            (format_piece_into<parsed, I>(sink, args, refs), ...);
+        }(std::make_index_sequence<parsed::size>{});
+    }
+}
+
+// Use as `format<"%0, %1!">(a, b)`.
+// Same as runtime version, only allocates memory once.
+template<details::fixed_string Fmt, typename... ArgsT>
+std::string format(ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    const auto refs = std::forward_as_tuple(args...);
+    std::string result;
+    details::append_with_reserve(result, [&table, &refs](auto& sink) {
+        details::format_into<Fmt>(sink, table, refs);
+    });
+    return result;
+}
+
+template<details::fixed_string Fmt, typename... ArgsT>
+void format_append(std::string& result, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    const auto refs = std::forward_as_tuple(args...);
+    details::append_with_reserve(result, [&table, &refs](auto& sink) {
+        details::format_into<Fmt>(sink, table, refs);
+    });
+}
+
+template<details::fixed_string Fmt, typename OutputIt, typename... ArgsT>
+OutputIt format_to(OutputIt out, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::iterator_sink<OutputIt> sink{out};
+    details::format_into<Fmt>(sink, table, std::forward_as_tuple(args...));
+    return sink.out;
+}
+
+template<details::fixed_string Fmt, typename OutputIt, typename... ArgsT>
+format_to_n_result<OutputIt> format_to_n(OutputIt out, size_t n, ArgsT&&... args)
+{
+    details::format_args<ArgsT...> table;
+    details::resolve_args(table, std::forward<ArgsT>(args)...);
+    details::bounded_sink<OutputIt> sink{out, n};
+    details::format_into<Fmt>(sink, table, std::forward_as_tuple(args...));
+    return {sink.out, sink.size};
+}
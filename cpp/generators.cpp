@@ -1,127 +1,14 @@
-/*
-Implementing generators (a variant of coroutine) with macros
-(based on [this article](https://www.codeproject.com/Tips/29524/Generators-in-C),
-in turn, based on [this article](http://www.chiark.greenend.org.uk/~sgtatham/coroutines.html).
-
-tl;dr: we are abusing the fact that `switch` allows to jump to a `case` label in the middle of the loop.
-(cf. Duff device)
-*/
-
-#include <iterator>
-#include <tuple>
-
-namespace details {
-    // dummy tag type to use for "are we done there yet?" checks
-    struct sentinel{};
-
-    // To be able to construct iterators with arguments, we are using template
-    // specialization.
-    template <typename SignatureT> struct iterator_base;
-
-    // Note that iterator_base is incomplete:
-    // it doesn't have `operator++` that is going to be implemented by
-    // our macros in a subclass.
-    template<typename ReturnT, typename... ArgsT>
-    struct iterator_base<ReturnT(ArgsT...)> {
-        using ArgsTuple = std::tuple<ArgsT...>;
-        
-        iterator_base(const ArgsTuple& args)
-        : args_{args}
-        {}
-
-        const ReturnT& operator*() const & {
-            return value_;
-        }
-        ReturnT&& operator*() && {
-            return std::move(value_);
-        }
-
-        bool operator==(sentinel) const {
-            return finished_;
-        }
-        bool operator!=(sentinel) const {
-            return !finished_;
-        }
-        
-    protected:
-        // a helper function to access arguments
-        template<size_t N>
-        auto&& arg() const { return std::get<N>(args_); }
-
-        const ArgsTuple args_;
-        ReturnT value_{};
-        int line_{};
-        bool finished_{};
-    };
-
-    // this is a simple range implementation.
-    // all the magic is done in the iterator implementation.
-    template <typename IterT, typename TSignature>
-    struct generator_base;
-
-    // using template specialization to "unpack" the function signature
-    template<typename IterT, typename ReturnT, typename... ArgsT>
-    struct generator_base<IterT, ReturnT(ArgsT...)> {
-        auto end() const {
-            return sentinel{};
-        }
-
-        auto begin() const { 
-            IterT it{args_}; // creating the iterator using the polymorphic staatic method.
-            // first iteration of the generator will go to the first $yield
-            return ++it;
-        }
-
-        generator_base(ArgsT&&... args)
-        : args_{std::forward<ArgsT>(args)...}
-        {}
-    private:
-        const std::tuple<ArgsT...> args_;
-    };
-}
-
-// Declare a generator type corresponding to the `SIGNATURE`
-// Since we really need nothing from it, it can be an alias to `generator_base`
-// Note that `iterator_##NAME` doesn't have body.
-// It is intentional: the following block will be used as the class body.
-// This allows to "convert" the "variables" at the top into the iterator fields (i.e. state).
-// However this also limits us in what we can put inside the class - we can only add things
-// in the beginning of `$start` or end of `$stop`
-#define $generator(NAME, SIGNATURE) using NAME = details::generator_base<struct iterator_##NAME, SIGNATURE>;\
-\
-class iterator_##NAME final: public details::iterator_base<SIGNATURE>
-
-// Actual code starts here. Initial value of `line_` is 0, so this is the starting point.
-// Note that we also import the base class constuctors here, to simplify the parameter passing.
-#define $start public:                  \
-    using iterator_base::iterator_base; \
-    auto& operator++() {                \
-        switch(line_) { case 0:;
-
-// `$yield` statement pauses the execution by "saving" the position into `line_`
-// and creating a label to return to.
-// Normally, we would use the `do{}while(0)` trick to create a new scope.
-// But we don't really have anything deserving a new scope.
-// Note that we use `return` and not `break` because there's a *good* chance that
-// `$yield` will be called inside a loop.
-#define $yield(V)               \
-            line_ = __LINE__;   \
-            value_ = (V);       \
-            return *this;       \
-        case __LINE__:;
-
-// finish execution by setting the flag
-// We also provide the final label here, but there're other ways.
-#define $stop                   \
-        default: line_ = 0;     \
-            finished_ = true;   \
-            return *this;       \
-        } /*end of switch*/     \
-    }                           \
-private:
+#define ALLOC_PROFILER_IMPLEMENTATION
+#include "alloc_profiler.h"
+// the same demo is built twice: as is, and with `-DGENERATOR_COROUTINES`
+#include "generators.h"
 
 // Demo time!
+#include <cassert>
 #include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
 
 // a generator emitting N first Fibonacci numbers
 $generator(fib, int(int)) {
@@ -136,9 +23,112 @@ $generator(fib, int(int)) {
     $stop;
 };  // note that we need a `;` here - otherwise the class declaration won't be finished and compiler will be sad.
 
+// yields temporaries, which can be moved out of the iterator
+$generator(repeat, std::string(std::string, int)) {
+    int i;
+    $start;
+    for (i = 0; i < arg<1>(); ++i) {
+        $yield(arg<0>() + std::to_string(i));
+    }
+    $stop;
+};
+
+// no `$yield` at all
+$generator(nothing, int()) {
+    $start;
+    $stop;
+};
+
 int main()
 {
     for (const auto& n : fib{10}) {
         std::fprintf(stderr, "%d\n", n);
     }
+
+    std::vector<int> numbers;
+    for (const auto& n : fib{10}) {
+        numbers.push_back(n);
+    }
+    assert((numbers == std::vector{1, 1, 2, 3, 5, 8, 13, 21, 34, 55}));
+
+    // the generator can be iterated again, from the start
+    const fib twice{3};
+    int sum = 0;
+    for (const auto& n : twice) {
+        sum += n;
+    }
+    for (const auto& n : twice) {
+        sum += n;
+    }
+    assert(sum == 8);
+
+    std::vector<std::string> strings;
+    const repeat r{"some long string that doesn't fit into SSO #", 3};
+    for (auto it = r.begin(); it != r.end(); ++it) {
+        strings.push_back(*std::move(it));
+    }
+    assert(strings.size() == 3 && strings[2] == "some long string that doesn't fit into SSO #2");
+
+    for ([[maybe_unused]] auto n : nothing{}) {
+        assert(false);
+    }
+
+    // pipelines
+    auto is_odd = [](int n) { return n % 2 != 0; };
+    auto square = [](int n) { return n * n; };
+    numbers.clear();
+    for (auto n : fib{20} | pipes::filter(is_odd) | pipes::map(square) | pipes::take(5)) {
+        numbers.push_back(n);
+    }
+    assert((numbers == std::vector{1, 1, 9, 25, 169}));
+
+    // an lvalue range is not copied, and anything with `begin()`/`end()` works
+    const std::vector<int> letters{'a', 'b', 'c', 'd'};
+    std::string zipped;
+    for (auto [n, c] : pipes::zip(twice, letters | pipes::map([](int c) { return char(c - 'a' + 'A'); }))) {
+        zipped += std::to_string(n) + c;
+    }
+    assert(zipped == "1A1B2C");
+
+    std::vector<size_t> sizes;
+    sum = 0;
+    for (auto chunk : fib{10} | pipes::batch<4>()) {
+        sizes.push_back(chunk.size());
+        for (auto n : chunk) {
+            sum += n;
+        }
+    }
+    assert((sizes == std::vector<size_t>{4, 4, 2}) && sum == 143);
+
+    for ([[maybe_unused]] auto chunk : nothing{} | pipes::batch<4>()) {
+        assert(false);
+    }
+    for ([[maybe_unused]] auto n : fib{10} | pipes::take(0)) {
+        assert(false);
+    }
+
+    // nothing is allocated: the switch-based iterator is all fields,
+    // and coroutine frames are recycled after the first use
+    for ([[maybe_unused]] auto n : fib{10}) {
+    }
+    {
+        alloc_profiler::scope allocs;
+        for (const auto& n : fib{20}) {
+            sum += n;
+        }
+        for (auto n : fib{20} | pipes::filter(is_odd) | pipes::map(square) | pipes::batch<8>()) {
+            sum += n[0];
+        }
+        assert(allocs.allocations() == 0);
+    }
+
+    // iterators (and coroutine frames) destroyed on another thread: its recycled blocks are freed when it exits
+    {
+        std::vector<fib> gens(10, fib{5});
+        std::vector<decltype(gens[0].begin())> its;
+        for (auto& gen : gens) {
+            its.push_back(gen.begin());
+        }
+        std::thread{[&] { its.clear(); }}.join();
+    }
 }
@@ -0,0 +1,601 @@
+#pragma once
+
+/*
+Implementing generators (a variant of coroutine) with macros
+(based on [this article](https://www.codeproject.com/Tips/29524/Generators-in-C),
+in turn, based on [this article](http://www.chiark.greenend.org.uk/~sgtatham/coroutines.html).
+
+tl;dr: we are abusing the fact that `switch` allows to jump to a `case` label in the middle of the loop.
+(cf. Duff device)
+*/
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace details {
+    // dummy tag type to use for "are we done there yet?" checks
+    struct sentinel{};
+
+    // To be able to construct iterators with arguments, we are using template
+    // specialization.
+    template <typename SignatureT> struct iterator_base;
+
+    // Note that iterator_base is incomplete:
+    // it doesn't have `operator++` that is going to be implemented by
+    // our macros in a subclass.
+    template<typename ReturnT, typename... ArgsT>
+    struct iterator_base<ReturnT(ArgsT...)> {
+        using ArgsTuple = std::tuple<ArgsT...>;
+        
+        iterator_base(const ArgsTuple& args)
+        : args_{args}
+        {}
+
+        const ReturnT& operator*() const & {
+            return value_;
+        }
+        ReturnT&& operator*() && {
+            return std::move(value_);
+        }
+
+        bool operator==(sentinel) const {
+            return finished_;
+        }
+        bool operator!=(sentinel) const {
+            return !finished_;
+        }
+        
+    protected:
+        // a helper function to access arguments
+        template<size_t N>
+        auto&& arg() const { return std::get<N>(args_); }
+
+        const ArgsTuple args_;
+        ReturnT value_{};
+        int line_{};
+        bool finished_{};
+    };
+
+    // this is a simple range implementation.
+    // all the magic is done in the iterator implementation.
+    template <typename IterT, typename TSignature>
+    struct generator_base;
+
+    // using template specialization to "unpack" the function signature
+    template<typename IterT, typename ReturnT, typename... ArgsT>
+    struct generator_base<IterT, ReturnT(ArgsT...)> {
+        auto end() const {
+            return sentinel{};
+        }
+
+        auto begin() const { 
+            IterT it{args_}; // creating the iterator using the polymorphic staatic method.
+            // first iteration of the generator will go to the first $yield
+            return ++it;
+        }
+
+        generator_base(ArgsT&&... args)
+        : args_{std::forward<ArgsT>(args)...}
+        {}
+    private:
+        const std::tuple<ArgsT...> args_;
+    };
+}
+
+// The same generators on top of C++20 coroutines (define `GENERATOR_COROUTINES` before including this header).
+// User code doesn't change: the fields before `$start` become fields of a "state" object,
+// and the code between `$start` and `$stop` becomes its member coroutine.
+// What changes:
+// - `$yield` doesn't copy the value: the iterator points to whatever was yielded
+//   (a field, a local or a temporary - they all live in the suspended coroutine until it's resumed);
+// - `begin()` doesn't copy the arguments: the state refers to the generator's ones,
+//   so the generator has to outlive its iterators (which it does in a range-for);
+// - the coroutine frame and the state are allocated, but from a per-thread pool, so after the first
+//   generator of a kind the memory is just recycled.
+namespace details {
+    // Per-thread free lists of blocks, by size class (multiples of `granularity`).
+    // Blocks are never given back to the system while the thread lives:
+    // generators of a program tend to have a handful of frame sizes, so the lists stay short.
+    // A block freed on another thread just moves to that thread's list.
+    class frame_pool {
+    public:
+        static void* allocate(size_t size) {
+            auto index = size_class(size);
+            if (index >= classes) {
+                return ::operator new(size);
+            }
+            if (auto block = heads[index]) {
+                heads[index] = block->next;
+                return block;
+            }
+            return ::operator new((index + 1) * granularity);
+        }
+
+        // A block goes to the list of the thread freeing it, which may not be the one that allocated it.
+        static void deallocate(void* p, size_t size) noexcept {
+            auto index = size_class(size);
+            if (index >= classes) {
+                ::operator delete(p);
+                return;
+            }
+            if (!heads[index]) {
+                // only when a list becomes non-empty, so the fast path doesn't pay for the thread_local with a destructor
+                static thread_local cleanup on_thread_exit;
+            }
+            heads[index] = ::new (p) free_block{heads[index]};
+        }
+
+    private:
+        static constexpr size_t granularity = 64;
+        static constexpr size_t classes = 16;   // up to 1K, bigger frames go straight to `operator new`
+
+        struct free_block {
+            free_block* next;
+        };
+
+        struct cleanup {
+            ~cleanup() {
+                for (auto& head : heads) {
+                    while (head) {
+                        ::operator delete(std::exchange(head, head->next));
+                    }
+                }
+            }
+        };
+
+        static size_t size_class(size_t size) {
+            return (size - 1) / granularity;
+        }
+
+        static inline thread_local free_block* heads[classes]{};
+    };
+
+    // The return type of the coroutine `$start` begins.
+    // It's just an owner of the handle, the iterator does the rest.
+    template<typename ReturnT>
+    struct coroutine {
+        struct promise_type {
+            const ReturnT* value_ = nullptr;
+            ReturnT* movable_ = nullptr;    // set if the yielded value may be moved from (i.e. it's an rvalue)
+
+            coroutine get_return_object() {
+                return coroutine{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            // the exception propagates to `operator++` (and the coroutine is finished)
+            void unhandled_exception() { throw; }
+
+            // No copies here: a temporary lives till the end of the full expression,
+            // and this expression ends after the coroutine is resumed.
+            std::suspend_always yield_value(const ReturnT& value) noexcept {
+                value_ = &value;
+                movable_ = nullptr;
+                return {};
+            }
+            std::suspend_always yield_value(ReturnT&& value) noexcept {
+                value_ = movable_ = &value;
+                return {};
+            }
+
+            static void* operator new(size_t size) {
+                return frame_pool::allocate(size);
+            }
+            static void operator delete(void* p, size_t size) noexcept {
+                frame_pool::deallocate(p, size);
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    template <typename SignatureT> struct coroutine_state;
+
+    // The base of the state: arguments access, like `iterator_base`.
+    template<typename ReturnT, typename... ArgsT>
+    struct coroutine_state<ReturnT(ArgsT...)> {
+        using ArgsTuple = std::tuple<ArgsT...>;
+        using return_type = ReturnT;
+
+        coroutine_state(const ArgsTuple& args)
+        : args_{args}
+        {}
+
+        // the state is referred to by its own coroutine
+        coroutine_state(const coroutine_state&) = delete;
+        coroutine_state& operator=(const coroutine_state&) = delete;
+
+    protected:
+        template<size_t N>
+        auto&& arg() const { return std::get<N>(args_); }
+
+        const ArgsTuple& args_;
+    };
+
+    // Owns the coroutine and its state, so it can only be moved.
+    template <typename StateT, typename ReturnT>
+    class coroutine_iterator {
+    public:
+        using ArgsTuple = typename StateT::ArgsTuple;
+        using promise_type = typename coroutine<ReturnT>::promise_type;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = ReturnT;
+        using difference_type = std::ptrdiff_t;
+
+        explicit coroutine_iterator(const ArgsTuple& args)
+        : state_{::new (frame_pool::allocate(sizeof(StateT))) StateT{args}}
+        {
+            static_assert(alignof(StateT) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+            try {
+                handle_ = state_->body().handle;
+            } catch (...) {
+                destroy_state();
+                throw;
+            }
+        }
+
+        coroutine_iterator(coroutine_iterator&& other) noexcept
+        : state_{std::exchange(other.state_, nullptr)}
+        , handle_{std::exchange(other.handle_, nullptr)}
+        {}
+
+        coroutine_iterator& operator=(coroutine_iterator&& other) noexcept {
+            std::swap(state_, other.state_);
+            std::swap(handle_, other.handle_);
+            return *this;
+        }
+
+        ~coroutine_iterator() {
+            if (handle_) {
+                handle_.destroy();
+            }
+            if (state_) {
+                destroy_state();
+            }
+        }
+
+        // points right into the coroutine: to the field, local or temporary passed to `$yield`
+        const ReturnT& operator*() const & {
+            return *handle_.promise().value_;
+        }
+        // moves the value out if it's a temporary (`$yield(std::move(x))` is fine too), copies otherwise
+        ReturnT operator*() && {
+            auto& promise = handle_.promise();
+            if (promise.movable_) {
+                return std::move(*promise.movable_);
+            }
+            return *promise.value_;
+        }
+
+        coroutine_iterator& operator++() {
+            handle_.resume();
+            return *this;
+        }
+
+        bool operator==(sentinel) const {
+            return handle_.done();
+        }
+        bool operator!=(sentinel) const {
+            return !handle_.done();
+        }
+
+    private:
+        void destroy_state() {
+            state_->~StateT();
+            frame_pool::deallocate(state_, sizeof(StateT));
+        }
+
+        StateT* state_;
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    template <typename StateT, typename TSignature>
+    struct coroutine_generator_base;
+
+    template<typename StateT, typename ReturnT, typename... ArgsT>
+    struct coroutine_generator_base<StateT, ReturnT(ArgsT...)> {
+        auto end() const {
+            return sentinel{};
+        }
+
+        auto begin() const {
+            coroutine_iterator<StateT, ReturnT> it{args_};
+            // run till the first `$yield`
+            ++it;
+            return it;
+        }
+
+        coroutine_generator_base(ArgsT&&... args)
+        : args_{std::forward<ArgsT>(args)...}
+        {}
+    private:
+        const std::tuple<ArgsT...> args_;
+    };
+}
+
+#if defined(GENERATOR_COROUTINES)
+
+// Here `iterator_##NAME` is not an iterator, but the state, the name is kept for symmetry.
+#define $generator(NAME, SIGNATURE) using NAME = details::coroutine_generator_base<struct iterator_##NAME, SIGNATURE>;\
+\
+class iterator_##NAME final: public details::coroutine_state<SIGNATURE>
+
+// `body` is a coroutine because of `co_yield` and `co_return` in it,
+// it's suspended right away and started by `begin()`.
+#define $start public:                      \
+    using coroutine_state::coroutine_state; \
+    details::coroutine<return_type> body() {
+
+#define $yield(V) co_yield (V)
+
+// `co_return` makes it a coroutine even if there're no `$yield`s
+#define $stop                               \
+        co_return;                          \
+    }                                       \
+private:
+
+#else
+
+// Declare a generator type corresponding to the `SIGNATURE`
+// Since we really need nothing from it, it can be an alias to `generator_base`
+// Note that `iterator_##NAME` doesn't have body.
+// It is intentional: the following block will be used as the class body.
+// This allows to "convert" the "variables" at the top into the iterator fields (i.e. state).
+// However this also limits us in what we can put inside the class - we can only add things
+// in the beginning of `$start` or end of `$stop`
+#define $generator(NAME, SIGNATURE) using NAME = details::generator_base<struct iterator_##NAME, SIGNATURE>;\
+\
+class iterator_##NAME final: public details::iterator_base<SIGNATURE>
+
+// Actual code starts here. Initial value of `line_` is 0, so this is the starting point.
+// Note that we also import the base class constuctors here, to simplify the parameter passing.
+#define $start public:                  \
+    using iterator_base::iterator_base; \
+    auto& operator++() {                \
+        switch(line_) { case 0:;
+
+// `$yield` statement pauses the execution by "saving" the position into `line_`
+// and creating a label to return to.
+// Normally, we would use the `do{}while(0)` trick to create a new scope.
+// But we don't really have anything deserving a new scope.
+// Note that we use `return` and not `break` because there's a *good* chance that
+// `$yield` will be called inside a loop.
+#define $yield(V)               \
+            line_ = __LINE__;   \
+            value_ = (V);       \
+            return *this;       \
+        case __LINE__:;
+
+// finish execution by setting the flag
+// We also provide the final label here, but there're other ways.
+#define $stop                   \
+        default: line_ = 0;     \
+            finished_ = true;   \
+            return *this;       \
+        } /*end of switch*/     \
+    }                           \
+private:
+
+#endif
+
+// Lazy combinators over generators (or any other ranges with `begin()` and `end()`):
+//
+//  for (auto n : fib{90} | pipes::filter(is_odd) | pipes::map(square) | pipes::take(5)) { ... }
+//  for (auto [a, b] : pipes::zip(fib{10}, fib{20})) { ... }
+//  for (std::span<const int> chunk : fib{90} | pipes::batch<16>()) { ... }
+//
+// Everything is a template over the concrete types (no `std::function`, no heap), and every stage
+// is a thin iterator over the previous one, so after inlining it's the same loop as written by hand.
+// Temporary ranges are moved into the pipeline, lvalues are referred to.
+// Note that `filter` dereferences the underlying iterator to check the predicate, and then again
+// to get the value, so expensive `map`s go after `filter`s.
+namespace pipes {
+    namespace details {
+        using ::details::sentinel;
+
+        template<typename RangeT>
+        using iterator_t = decltype(std::declval<RangeT&>().begin());
+        template<typename RangeT>
+        using end_t = decltype(std::declval<RangeT&>().end());
+
+        // a stage waiting for its range on the left of `|`
+        template<typename MakeT>
+        struct pipe {
+            MakeT make;
+        };
+
+        template<typename RangeT, typename PredT>
+        struct filter_range {
+            RangeT range_;
+            PredT pred_;
+
+            struct iterator {
+                iterator_t<RangeT> it_;
+                end_t<RangeT> end_;
+                const PredT* pred_;
+
+                void skip() {
+                    while (it_ != end_ && !(*pred_)(*it_)) {
+                        ++it_;
+                    }
+                }
+                decltype(auto) operator*() const { return *it_; }
+                iterator& operator++() {
+                    ++it_;
+                    skip();
+                    return *this;
+                }
+                bool operator==(sentinel) const { return it_ == end_; }
+            };
+
+            iterator begin() {
+                iterator it{range_.begin(), range_.end(), &pred_};
+                it.skip();
+                return it;
+            }
+            sentinel end() const { return {}; }
+        };
+
+        template<typename RangeT, typename FuncT>
+        struct map_range {
+            RangeT range_;
+            FuncT func_;
+
+            struct iterator {
+                iterator_t<RangeT> it_;
+                end_t<RangeT> end_;
+                const FuncT* func_;
+
+                decltype(auto) operator*() const { return (*func_)(*it_); }
+                iterator& operator++() {
+                    ++it_;
+                    return *this;
+                }
+                bool operator==(sentinel) const { return it_ == end_; }
+            };
+
+            iterator begin() { return {range_.begin(), range_.end(), &func_}; }
+            sentinel end() const { return {}; }
+        };
+
+        template<typename RangeT>
+        struct take_range {
+            RangeT range_;
+            size_t count_;
+
+            struct iterator {
+                iterator_t<RangeT> it_;
+                end_t<RangeT> end_;
+                size_t left_;
+
+                decltype(auto) operator*() const { return *it_; }
+                // doesn't advance past the last one taken: a generator may have side effects
+                iterator& operator++() {
+                    if (--left_ != 0) {
+                        ++it_;
+                    }
+                    return *this;
+                }
+                bool operator==(sentinel) const { return left_ == 0 || it_ == end_; }
+            };
+
+            iterator begin() { return {range_.begin(), range_.end(), count_}; }
+            sentinel end() const { return {}; }
+        };
+
+        template<typename FirstT, typename SecondT>
+        struct zip_range {
+            FirstT first_;
+            SecondT second_;
+
+            struct iterator {
+                iterator_t<FirstT> first_;
+                end_t<FirstT> first_end_;
+                iterator_t<SecondT> second_;
+                end_t<SecondT> second_end_;
+
+                // references if the underlying iterators give references, values otherwise
+                auto operator*() const {
+                    return std::pair<decltype(*first_), decltype(*second_)>{*first_, *second_};
+                }
+                iterator& operator++() {
+                    ++first_;
+                    ++second_;
+                    return *this;
+                }
+                bool operator==(sentinel) const { return first_ == first_end_ || second_ == second_end_; }
+            };
+
+            iterator begin() { return {first_.begin(), first_.end(), second_.begin(), second_.end()}; }
+            sentinel end() const { return {}; }
+        };
+
+        // Copies values into a fixed buffer and hands out up to N of them at once (the last batch may be shorter),
+        // so the consumer can run a plain loop over an array, which compilers know how to vectorize.
+        template<typename RangeT, size_t N>
+        struct batch_range {
+            using value_type = std::remove_cvref_t<decltype(*std::declval<iterator_t<RangeT>&>())>;
+
+            RangeT range_;
+            // here and not in the iterator: stores into it could alias the state of the underlying iterator,
+            // which would be reloaded after every store
+            std::array<value_type, N> values_{};
+
+            struct iterator {
+                iterator_t<RangeT> it_;
+                end_t<RangeT> end_;
+                value_type* values_;
+                size_t size_ = 0;
+
+                void fill() {
+                    size_t size = 0;
+                    for (; size < N && it_ != end_; ++size, ++it_) {
+                        values_[size] = *it_;
+                    }
+                    size_ = size;
+                }
+                std::span<const value_type> operator*() const { return {values_, size_}; }
+                iterator& operator++() {
+                    fill();
+                    return *this;
+                }
+                bool operator==(sentinel) const { return size_ == 0; }
+            };
+
+            iterator begin() {
+                iterator it{range_.begin(), range_.end(), values_.data()};
+                it.fill();
+                return it;
+            }
+            sentinel end() const { return {}; }
+        };
+    }
+
+    // `range | stage`: an rvalue range is moved into the stage, an lvalue one is referred to
+    template<typename RangeT, typename MakeT>
+    auto operator|(RangeT&& range, details::pipe<MakeT> stage) {
+        return stage.make(std::forward<RangeT>(range));
+    }
+
+    template<typename PredT>
+    auto filter(PredT pred) {
+        return details::pipe{[pred]<typename RangeT>(RangeT&& range) {
+            return details::filter_range<RangeT, PredT>{std::forward<RangeT>(range), pred};
+        }};
+    }
+
+    template<typename FuncT>
+    auto map(FuncT func) {
+        return details::pipe{[func]<typename RangeT>(RangeT&& range) {
+            return details::map_range<RangeT, FuncT>{std::forward<RangeT>(range), func};
+        }};
+    }
+
+    inline auto take(size_t count) {
+        return details::pipe{[count]<typename RangeT>(RangeT&& range) {
+            return details::take_range<RangeT>{std::forward<RangeT>(range), count};
+        }};
+    }
+
+    template<size_t N>
+    auto batch() {
+        static_assert(N > 0);
+        return details::pipe{[]<typename RangeT>(RangeT&& range) {
+            return details::batch_range<RangeT, N>{std::forward<RangeT>(range)};
+        }};
+    }
+
+    // stops at the end of the shorter one
+    template<typename FirstT, typename SecondT>
+    auto zip(FirstT&& first, SecondT&& second) {
+        return details::zip_range<FirstT, SecondT>{std::forward<FirstT>(first), std::forward<SecondT>(second)};
+    }
+}
@@ -1,87 +1,11 @@
-#include <memory>
-#include <cstdio> // for examples to run
-#include <string> // ditto
+#include "handle_wrapper.h"
 
-// A lot of libraries expose C-style API operating on opaque pointers (AKA handles).
-// Such code is leak-prone unless RAII is enforced.
-// Here're utilities providing slightly different ways for that
-
-// Quick&Dirty way: use std::unique_ptr:
-template <typename T, typename TDeleter>
-std::unique_ptr<T, TDeleter> wrap(T *pointer, TDeleter deleter)
-{
-    return {pointer, deleter};
-}
-
-// More thorough way:
-// (the main difference is that users don't need to call .get())
-template <typename THandle, typename Deleter>
-struct Handle
-{
-    std::unique_ptr<THandle, Deleter> _ptr;
-    Handle(THandle *h, Deleter d)
-        : _ptr{h, d}
-    {
-        // we may also want to validate the pointer before assigning it.
-    }
-
-    operator THandle *()
-    {
-        return _ptr.get();
-    }
-};
-// Before C++14 this function helps to avoid specifying types.
-// With C++17 or later it's not needed thanks to the Template Argument Deduction
-template <typename THandle, typename Deleter>
-auto wrapHandle(THandle *h, Deleter d)
-{
-    return Handle<THandle, Deleter>{h, d};
-}
-
-// It's also much easier to make better wrappers later
-#include <type_traits>
-struct FileHandle : public Handle<FILE, std::add_pointer<decltype(std::fclose)>::type>
-{
-    static constexpr char *READONLY = "r";
-    static constexpr char *WRITEONLY = "w";
-    // etc
-
-    FileHandle(const std::string &path, char *access)
-        : Handle{std::fopen(path.data(), access), &std::fclose}
-    {
-    }
-
-    template <size_t N>
-    void get_string(char (&buf)[N])
-    {
-        std::fgets(buf, N, *this);
-    }
-};
-
-// Semi-related: scope quard aka `defer`
-// std::experimental::scope_exit (in <experimental/scope>) is a better option though.
-template <typename TFunc>
-struct scope_guard
-{
-    TFunc f;
-    scope_guard() = delete;
-    scope_guard(const scope_guard &) = delete;
-    scope_guard &operator=(const scope_guard &) = delete;
-
-    ~scope_guard()
-    {
-        f();
-    }
-};
-// deduction guide for C++17 and later
-template <class TFunc>
-scope_guard(TFunc) -> scope_guard<TFunc>;
-// a function for C+14
-template <typename TFunc>
-scope_guard<TFunc> on_scope(TFunc &&f)
-{
-    return scope_guard<TFunc>{f};
-}
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 int main()
 {
@@ -116,4 +40,143 @@ int main()
         fgets(buf, size(buf), file);
         fprintf(stderr, "%s\n", buf);
     }
+    // pooling: "closed" handles are kept open and given out again
+    {
+        FileHandlePool pool{2, 1};
+        char first[100];
+        FILE *pooled;
+        {
+            auto file = pool.acquire("README.md", FileHandle::READONLY);
+            assert(file);
+            fgets(first, size(first), file);
+            pooled = file;
+        } // back to the pool, not closed
+        {
+            auto file = pool.acquire("README.md", FileHandle::READONLY);
+            assert(file.get() == pooled);
+            char buf[100];
+            fgets(buf, size(buf), file); // rewound
+            assert(strcmp(buf, first) == 0);
+
+            // the same path is leased already: another handle is opened
+            auto another = pool.acquire("README.md", FileHandle::READONLY);
+            assert(another && another.get() != pooled);
+        }
+        assert(!pool.acquire("no such file", FileHandle::READONLY));
+        auto stats = pool.stats();
+        assert(stats.hits == 1 && stats.misses == 3 && stats.evictions == 0 && stats.idle == 2);
+
+        // capacity is 2: the least recently returned one is closed
+        pool.acquire("CMakeLists.txt", FileHandle::READONLY);
+        stats = pool.stats();
+        assert(stats.evictions == 1 && stats.idle == 2);
+    }
+    // ... from many threads
+    {
+        FileHandlePool pool{8};
+        const char *paths[] = {"README.md", "CMakeLists.txt", "handle_wrapper.h", "handle_wrapper.cpp"};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    auto file = pool.acquire(paths[(t + i) % size(paths)], FileHandle::READONLY);
+                    assert(file && fgetc(file) != EOF);
+                }
+            });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        auto stats = pool.stats();
+        assert(stats.hits + stats.misses == 4000);
+        assert(stats.misses - stats.evictions == stats.idle);
+        assert(stats.hit_rate() > 0.5);
+    }
+    // the capacity holds with the default number of shards too
+    {
+        FileHandlePool pool{2};
+        const char *paths[] = {"README.md", "CMakeLists.txt", "handle_wrapper.h", "handle_wrapper.cpp"};
+        std::vector<FileHandlePool::Lease> leases;
+        for (auto path : paths)
+        {
+            leases.push_back(pool.acquire(path, FileHandle::READONLY));
+        }
+        leases.clear();
+        auto stats = pool.stats();
+        assert(stats.idle <= 2 && stats.idle + stats.evictions == 4);
+    }
+    // no capacity: nothing is kept
+    {
+        FileHandlePool pool{0};
+        pool.acquire("README.md", FileHandle::READONLY);
+        pool.acquire("README.md", FileHandle::READONLY);
+        auto stats = pool.stats();
+        assert(stats.hits == 0 && stats.misses == 2 && stats.evictions == 2 && stats.idle == 0);
+    }
+#if __has_include(<sys/mman.h>)
+    // reading lines without copying them
+    {
+        std::vector<std::string> expected;
+        {
+            auto file = FileHandle("README.md", FileHandle::READONLY);
+            char buf[4096];
+            while (fgets(buf, size(buf), file))
+            {
+                expected.emplace_back(buf, strcspn(buf, "\n"));
+            }
+        }
+
+        FileReader mapped{"README.md"};
+        assert(mapped.is_mapped());
+        size_t count = 0;
+        for (string_view line : mapped.lines())
+        {
+            assert(count < expected.size() && line == expected[count]);
+            ++count;
+        }
+        assert(count == expected.size());
+
+        // a pipe is read into the buffer; a tiny one makes it grow and move partial lines
+        int fds[2];
+        assert(pipe(fds) == 0);
+        std::thread writer{[fd = fds[1]] {
+            const char text[] = "first line\n\na long line that doesn't fit\nno newline at the end";
+            for (size_t i = 0; i < sizeof(text) - 1; i += 5)
+            {
+                [[maybe_unused]] auto written = write(fd, text + i, std::min<size_t>(5, sizeof(text) - 1 - i));
+            }
+            close(fd);
+        }};
+        FileReader piped{fds[0], 4};
+        assert(!piped.is_mapped());
+        std::vector<std::string> copies;
+        for (string_view line : piped.lines())
+        {
+            copies.emplace_back(line);
+        }
+        writer.join();
+        assert((copies == std::vector<std::string>{"first line", "", "a long line that doesn't fit", "no newline at the end"}));
+
+        FileReader csv{"CMakeLists.txt"};
+        string_view record;
+        assert(csv.next(record, ' ') && record == "cmake_minimum_required(VERSION");
+
+        FileReader empty{"/dev/null"};
+        assert(empty.lines().begin() == empty.lines().end());
+
+        bool thrown = false;
+        try
+        {
+            FileReader missing{"no such file"};
+        }
+        catch (const std::system_error &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+#endif
 }
\ No newline at end of file
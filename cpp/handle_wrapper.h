@@ -0,0 +1,554 @@
+#pragma once
+
+#include <memory>
+#include <cstdio>
+#include <string>
+
+// A lot of libraries expose C-style API operating on opaque pointers (AKA handles).
+// Such code is leak-prone unless RAII is enforced.
+// Here're utilities providing slightly different ways for that
+
+// Quick&Dirty way: use std::unique_ptr:
+template <typename T, typename TDeleter>
+std::unique_ptr<T, TDeleter> wrap(T *pointer, TDeleter deleter)
+{
+    return {pointer, deleter};
+}
+
+// More thorough way:
+// (the main difference is that users don't need to call .get())
+template <typename THandle, typename Deleter>
+struct Handle
+{
+    std::unique_ptr<THandle, Deleter> _ptr;
+    Handle(THandle *h, Deleter d)
+        : _ptr{h, d}
+    {
+        // we may also want to validate the pointer before assigning it.
+    }
+
+    operator THandle *()
+    {
+        return _ptr.get();
+    }
+};
+// Before C++14 this function helps to avoid specifying types.
+// With C++17 or later it's not needed thanks to the Template Argument Deduction
+template <typename THandle, typename Deleter>
+auto wrapHandle(THandle *h, Deleter d)
+{
+    return Handle<THandle, Deleter>{h, d};
+}
+
+// It's also much easier to make better wrappers later
+#include <type_traits>
+struct FileHandle : public Handle<FILE, std::add_pointer<decltype(std::fclose)>::type>
+{
+    static constexpr const char *READONLY = "r";
+    static constexpr const char *WRITEONLY = "w";
+    // etc
+
+    FileHandle(const std::string &path, const char *access)
+        : Handle{std::fopen(path.data(), access), &std::fclose}
+    {
+    }
+
+    // (to read many lines, `FileReader` below is much faster)
+    template <size_t N>
+    void get_string(char (&buf)[N])
+    {
+        std::fgets(buf, N, *this);
+    }
+};
+
+// Semi-related: scope quard aka `defer`
+// std::experimental::scope_exit (in <experimental/scope>) is a better option though.
+template <typename TFunc>
+struct scope_guard
+{
+    TFunc f;
+    scope_guard(TFunc func)
+        : f{func}
+    {
+    }
+    scope_guard() = delete;
+    scope_guard(const scope_guard &) = delete;
+    scope_guard &operator=(const scope_guard &) = delete;
+
+    ~scope_guard()
+    {
+        f();
+    }
+};
+// deduction guide for C++17 and later
+template <class TFunc>
+scope_guard(TFunc) -> scope_guard<TFunc>;
+// a function for C+14
+template <typename TFunc>
+scope_guard<TFunc> on_scope(TFunc &&f)
+{
+    return scope_guard<TFunc>{f};
+}
+
+// Pooling: when the same files are opened again and again, `fopen`/`fclose` (i.e. `open`/`close` syscalls)
+// become noticeable. `FileHandlePool` keeps closed handles open instead, up to `capacity` idle ones,
+// and gives them out again for the same path and mode (rewound to the beginning, as if reopened).
+// Note that it's not exactly the same as reopening: a file opened for writing ("w") is not truncated again,
+// and changes of the file itself (e.g. it's replaced by another one) are not noticed.
+//
+// Use:
+//  FileHandlePool pool{256};
+//  {
+//      auto file = pool.acquire("data.txt", FileHandle::READONLY);
+//      std::fgets(buf, sizeof(buf), file);
+//  } // the handle goes back to the pool
+//
+// Thread-safe: the handles are split between shards by path, each with its own lock,
+// and `fopen`/`fclose` are called without holding a lock.
+// The pool must outlive the leases.
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class FileHandlePool
+{
+    struct Entry;
+
+public:
+    // A handle taken from the pool, returned there when destroyed.
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(Lease &&other) noexcept
+            : _pool{std::exchange(other._pool, nullptr)}, _entry{std::exchange(other._entry, nullptr)}
+        {
+        }
+        Lease &operator=(Lease &&other) noexcept
+        {
+            std::swap(_pool, other._pool);
+            std::swap(_entry, other._entry);
+            return *this;
+        }
+        ~Lease()
+        {
+            if (_entry)
+            {
+                _pool->release(_entry);
+            }
+        }
+
+        // `nullptr` if the file couldn't be opened
+        FILE *get() const
+        {
+            return _entry ? static_cast<FILE *>(_entry->handle) : nullptr;
+        }
+        operator FILE *() const
+        {
+            return get();
+        }
+        explicit operator bool() const
+        {
+            return get() != nullptr;
+        }
+
+    private:
+        friend class FileHandlePool;
+        Lease(FileHandlePool *pool, Entry *entry)
+            : _pool{pool}, _entry{entry}
+        {
+        }
+
+        FileHandlePool *_pool = nullptr;
+        Entry *_entry = nullptr;
+    };
+
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;      // including failed opens
+        size_t evictions = 0;
+        size_t idle = 0;
+
+        double hit_rate() const
+        {
+            return hits + misses ? double(hits) / double(hits + misses) : 0.0;
+        }
+    };
+
+    // No more shards than `capacity`, so every shard can keep at least one handle (and at most `capacity` in total).
+    // With `capacity` 0 nothing is kept: returned handles are closed right away.
+    explicit FileHandlePool(size_t capacity = 256, size_t shards = 16)
+        : _shards(std::clamp<size_t>(shards, 1, std::max<size_t>(capacity, 1))),
+          _shard_capacity{capacity / _shards.size()}
+    {
+    }
+
+    FileHandlePool(const FileHandlePool &) = delete;
+    FileHandlePool &operator=(const FileHandlePool &) = delete;
+
+    Lease acquire(std::string_view path, const char *mode)
+    {
+        auto hash = std::hash<std::string_view>{}(path);
+        auto &shard = _shards[hash % _shards.size()];
+        {
+            std::lock_guard lock{shard.mutex};
+            auto [first, last] = shard.entries.equal_range(path);
+            for (auto it = first; it != last; ++it)
+            {
+                auto entry = it->second.get();
+                if (entry->idle && entry->mode == mode)
+                {
+                    shard.unlink(entry);
+                    ++shard.stats.hits;
+                    std::rewind(entry->handle);  // also clears EOF and error flags
+                    return {this, entry};
+                }
+            }
+            ++shard.stats.misses;
+        }
+
+        FileHandle handle{std::string{path}, mode};
+        if (!handle)
+        {
+            return {};
+        }
+        auto entry = std::make_unique<Entry>(Entry{std::string{path}, mode, std::move(handle), &shard});
+        auto raw = entry.get();
+        std::lock_guard lock{shard.mutex};
+        shard.entries.emplace(raw->path, std::move(entry));
+        return {this, raw};
+    }
+
+    Stats stats() const
+    {
+        Stats total;
+        for (auto &shard : _shards)
+        {
+            std::lock_guard lock{shard.mutex};
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.evictions += shard.stats.evictions;
+            total.idle += shard.idle_count;
+        }
+        return total;
+    }
+
+private:
+    struct Shard;
+
+    // Every open handle, leased or idle (closed when the entry is destroyed). Idle ones are also in the shard's LRU list (intrusive, so returning
+    // a handle doesn't allocate).
+    struct Entry
+    {
+        std::string path;
+        std::string mode;
+        FileHandle handle;
+        Shard *shard;
+        bool idle = false;
+        Entry *newer = nullptr;
+        Entry *older = nullptr;
+    };
+
+    // `std::string_view` lookups without making a `std::string`
+    struct PathHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view path) const
+        {
+            return std::hash<std::string_view>{}(path);
+        }
+    };
+
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_multimap<std::string, std::unique_ptr<Entry>, PathHash, std::equal_to<>> entries;
+        Entry *newest = nullptr;
+        Entry *oldest = nullptr;
+        size_t idle_count = 0;
+        Stats stats;
+
+        void link(Entry *entry)
+        {
+            entry->idle = true;
+            entry->older = newest;
+            entry->newer = nullptr;
+            (newest ? newest->newer : oldest) = entry;
+            newest = entry;
+            ++idle_count;
+        }
+
+        void unlink(Entry *entry)
+        {
+            entry->idle = false;
+            (entry->newer ? entry->newer->older : newest) = entry->older;
+            (entry->older ? entry->older->newer : oldest) = entry->newer;
+            --idle_count;
+        }
+
+        // takes the entry out of the map, so the file can be closed without holding the lock
+        std::unique_ptr<Entry> remove(Entry *entry)
+        {
+            auto [first, last] = entries.equal_range(entry->path);
+            auto it = std::find_if(first, last, [&](auto &item) { return item.second.get() == entry; });
+            auto removed = std::move(it->second);
+            entries.erase(it);
+            return removed;
+        }
+    };
+
+    void release(Entry *entry)
+    {
+        auto &shard = *entry->shard;
+        std::unique_ptr<Entry> evicted;    // closed after unlocking
+        {
+            std::lock_guard lock{shard.mutex};
+            shard.link(entry);
+            if (shard.idle_count > _shard_capacity)
+            {
+                auto oldest = shard.oldest;
+                shard.unlink(oldest);
+                ++shard.stats.evictions;
+                evicted = shard.remove(oldest);
+            }
+        }
+    }
+
+    std::vector<Shard> _shards;
+    const size_t _shard_capacity;
+};
+
+// Reading lines fast: `FileHandle::get_string` is `fgets`, which copies every line into the caller's buffer
+// (and locks the `FILE` each time). `FileReader` gives lines (or other records) as `std::string_view`s
+// right from a memory-mapped file, or, for pipes and such, from its own buffer filled by big `read`s.
+// A record is valid till the next one is read. Both ways tell the kernel the file is read sequentially,
+// so it reads ahead more.
+//
+// Use:
+//  FileReader reader{"data.csv"};
+//  for (std::string_view line : reader.lines()) { ... }
+//
+// Throws `std::system_error` if the file can't be opened or read.
+#if __has_include(<sys/mman.h>)
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class FileReader
+{
+public:
+    explicit FileReader(const std::string &path, size_t buffer_size = 1 << 20)
+        : FileReader{open(path), buffer_size}
+    {
+    }
+
+    // Takes ownership of the descriptor, e.g. of a pipe.
+    explicit FileReader(int fd, size_t buffer_size = 1 << 20)
+        : _fd{fd}
+    {
+        struct stat info;
+        if (::fstat(_fd, &info) != 0)
+        {
+            auto error = errno;
+            ::close(_fd);
+            throw std::system_error(error, std::system_category(), "fstat");
+        }
+        // fails for pipes, nothing to do about it
+        ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        // (files in /proc and such have zero size, though they aren't empty)
+        if (S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            auto mapping = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                ::madvise(mapping, size_t(info.st_size), MADV_SEQUENTIAL);
+                _data = static_cast<char *>(mapping);
+                _mapped = _end = size_t(info.st_size);
+                _eof = true;
+                return;
+            }
+        }
+        _buffer.resize(std::max<size_t>(buffer_size, 1));
+        _data = _buffer.data();
+    }
+
+    ~FileReader()
+    {
+        if (_mapped)
+        {
+            ::munmap(_data, _mapped);
+        }
+        ::close(_fd);
+    }
+
+    FileReader(const FileReader &) = delete;
+    FileReader &operator=(const FileReader &) = delete;
+
+    bool is_mapped() const
+    {
+        return _mapped != 0;
+    }
+
+    // The next record without the delimiter; `false` at the end of the file.
+    // The last record may have no delimiter after it.
+    bool next(std::string_view &record, char delimiter = '\n')
+    {
+        for (;;)
+        {
+            auto found = static_cast<char *>(std::memchr(_data + _scanned, delimiter, _end - _scanned));
+            if (found)
+            {
+                record = {_data + _begin, size_t(found - _data) - _begin};
+                _begin = _scanned = size_t(found - _data) + 1;
+                return true;
+            }
+            _scanned = _end;
+            if (_eof)
+            {
+                if (_begin == _end)
+                {
+                    return false;
+                }
+                record = {_data + _begin, _end - _begin};
+                _begin = _end;
+                return true;
+            }
+            fill();
+        }
+    }
+
+    class Records
+    {
+    public:
+        class iterator
+        {
+        public:
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+
+            iterator &operator++()
+            {
+                _done = !_reader->next(_record, _delimiter);
+                return *this;
+            }
+            void operator++(int)
+            {
+                ++*this;
+            }
+            const std::string_view &operator*() const
+            {
+                return _record;
+            }
+            bool operator==(std::default_sentinel_t) const
+            {
+                return _done;
+            }
+
+        private:
+            friend class Records;
+            iterator(FileReader *reader, char delimiter)
+                : _reader{reader}, _delimiter{delimiter}
+            {
+            }
+
+            FileReader *_reader;
+            char _delimiter;
+            std::string_view _record;
+            bool _done = false;
+        };
+
+        // single pass: `begin()` reads the first record
+        iterator begin()
+        {
+            iterator it{_reader, _delimiter};
+            return ++it;
+        }
+        std::default_sentinel_t end() const
+        {
+            return {};
+        }
+
+    private:
+        friend class FileReader;
+        Records(FileReader *reader, char delimiter)
+            : _reader{reader}, _delimiter{delimiter}
+        {
+        }
+
+        FileReader *_reader;
+        char _delimiter;
+    };
+
+    Records lines()
+    {
+        return {this, '\n'};
+    }
+    Records records(char delimiter)
+    {
+        return {this, delimiter};
+    }
+
+private:
+    static int open(const std::string &path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::system_category(), "open " + path);
+        }
+        return fd;
+    }
+
+    // Moves the unfinished record to the front of the buffer (growing it if the record fills it) and reads more.
+    void fill()
+    {
+        if (_begin > 0)
+        {
+            std::memmove(_data, _data + _begin, _end - _begin);
+            _end -= _begin;
+            _scanned -= _begin;
+            _begin = 0;
+        }
+        if (_end == _buffer.size())
+        {
+            _buffer.resize(_buffer.size() * 2);
+            _data = _buffer.data();
+        }
+        for (;;)
+        {
+            auto size = ::read(_fd, _data + _end, _buffer.size() - _end);
+            if (size >= 0)
+            {
+                _end += size_t(size);
+                _eof = size == 0;
+                return;
+            }
+            if (errno != EINTR)
+            {
+                throw std::system_error(errno, std::system_category(), "read");
+            }
+        }
+    }
+
+    int _fd;
+    char *_data = nullptr;      // the mapping or `_buffer`
+    size_t _mapped = 0;
+    std::vector<char> _buffer;
+    size_t _begin = 0;          // the next record
+    size_t _scanned = 0;        // where to look for the delimiter
+    size_t _end = 0;
+    bool _eof = false;
+};
+#endif
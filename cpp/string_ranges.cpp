@@ -1,106 +1,484 @@
-#include <string_view>
-#include <cstring>
+#include "string_ranges.h"
 
-// C++ makes it notoriously hard to split a string or string view into segments.
-// This is an example using `strpbrk` for delimiting.
-// Can be easily updated to use `strchr`, `strstr`, or `find`, say.
-struct split_range
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+template<typename RangeT>
+std::vector<std::string_view> collect(const RangeT &range)
 {
-    split_range(const std::string_view &s, const char *delims)
-        : s_(s), delims_(delims)
+    std::vector<std::string_view> result;
+    for (const auto &sv : range)
     {
+        result.push_back(sv);
     }
+    return result;
+}
 
-    struct sentinel_iterator
-    {
-    };
-
-    struct iterator
+// `rx::regex_range` finds the same matches as `pike::regex_range`
+template<rx::fixed_string Pattern>
+void check_compile_time_regex(const std::vector<std::string> &inputs)
+{
+    pike::regex expected_rx{Pattern.view()};
+    for (const auto &input : inputs)
     {
-        iterator(const std::string_view &s, const char *delims)
-            : delims_{delims}, begin_{s.data()}, end_{strpbrk(begin_, delims_)}, end_of_string_{s.data() + s.size()}
+        pike::regex_range expected_range{expected_rx, input};
+        auto expected = expected_range.begin();
+        for (const auto &m : rx::regex_range<Pattern>{input})
         {
-            if (!end_)
+            assert(expected != expected_range.end());
+            assert(m.size() == expected->size());
+            for (size_t i = 0; i < m.size(); ++i)
             {
-                end_ = end_of_string_;
+                assert(m.matched(i) == expected->matched(i));
+                assert(!m.matched(i) || (m.position(i) == expected->position(i) && m[i] == expected->str(i)));
             }
+            ++expected;
         }
-        iterator &operator++()
+        assert(expected == expected_range.end());
+    }
+}
+
+// use:
+int main()
+{
+    // splitting
+    {
+        for (const auto &sv : split_range{"   1:2, 3:10, 11:20", ",:"})
         {
-            begin_ = end_ + 1;
-            end_ = strpbrk(end_ + 1, delims_);
-            if (!end_)
+            std::cout << sv << "\n";
+        }
+    }
+    // matching
+    {
+        std::regex rx_pair{"\\d+:\\d+"};
+        for (const auto &m : regex_range{rx_pair, "   1:2, 3:10, 11:20"})
+        {
+            std::cout << m.str() << "\n";
+        }
+    }
+
+    // `split_range` gives the same segments as the `strpbrk` version
+    {
+        std::mt19937 random{42};
+        const char *delim_sets[] = {
+            ",:",            // few chars: compared one by one without SSSE3
+            ",:;|\t",        // more chars, still few high nibbles
+            " ,:;Aa\x7f\xe9\x10\x01", // many high nibbles: bitmap only
+        };
+        for (auto delims : delim_sets)
+        {
+            std::string alphabet = std::string{delims} + "xyz01";
+            for (size_t size = 0; size < 200; ++size)
             {
-                end_ = end_of_string_;
+                std::string s;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    s += alphabet[random() % alphabet.size()];
+                }
+                assert(collect(split_range{s, delims}) == collect(strpbrk_split_range{s, delims}));
             }
-            return *this;
         }
-        std::string_view operator*() const
+    }
+    // bulk: delimiter positions, in one pass
+    {
+        std::mt19937 random{7};
+        const std::string alphabet = ",:xyz01";
+        std::string s;
+        std::vector<size_t> offsets;
+        thread_pool pool{4};
+        parallel_splitter splitter{pool, 100};
+        std::vector<size_t> parallel_offsets;
+        for (size_t size = 0; size < 1000; size += 1 + size / 8)
         {
-            return {begin_, static_cast<size_t>(end_ - begin_)};
+            std::vector<size_t> expected;
+            for (size_t i = 0; i < s.size(); ++i)
+            {
+                if (s[i] == ',' || s[i] == ':')
+                {
+                    expected.push_back(i);
+                }
+            }
+            split_offsets(s, char_set{",:"}, offsets);
+            assert(offsets == expected);
+            splitter.split_offsets(s, char_set{",:"}, parallel_offsets);
+            assert(parallel_offsets == expected);
+            s += alphabet[random() % alphabet.size()];
         }
-        bool operator!=(sentinel_iterator) const
+        // all delimiters: more than 8 per 64 bytes
+        split_offsets(std::string(1000, ','), char_set{","}, offsets);
+        assert(offsets.size() == 1000 && offsets[999] == 999);
+    }
+    // quotes and escapes
+    {
+        std::vector<std::vector<std::string_view>> records;
+        csv_record record;
+        quoted_splitter splitter{"a,\"b,c\",d\n\"x\ny\",\"say \"\"hi\"\"\"\nlast"};
+        while (splitter.next(record))
         {
-            return begin_ < end_of_string_;
+            records.push_back(record.fields);
         }
+        assert(records.size() == 3);
+        assert((records[0] == std::vector<std::string_view>{"a", "\"b,c\"", "d"}));
+        assert((records[1] == std::vector<std::string_view>{"\"x\ny\"", "\"say \"\"hi\"\"\""}));
+        assert((records[2] == std::vector<std::string_view>{"last"}));
 
-        //private:
-        const char *delims_;
-        const char *begin_;
-        const char *end_;
-        const char *end_of_string_;
-    };
+        quoted_splitter escaped{"a\\,b,c\\\\,d\\\"e,f", {.escape = '\\'}};
+        assert(escaped.next(record) && record.fields.size() == 4);
+        assert(record.fields[0] == "a\\,b" && record.fields[1] == "c\\\\" && record.fields[2] == "d\\\"e");
+    }
+    // compared with the plain state machine on random data, for all the block boundaries
+    {
+        std::mt19937 random{1};
+        const std::string alphabet = ",\n\"\\xy";
+        const csv_dialect dialect{.escape = '\\'};
+        for (int round = 0; round < 300; ++round)
+        {
+            std::string s;
+            auto size = random() % 300;
+            for (size_t i = 0; i < size; ++i)
+            {
+                s += alphabet[random() % alphabet.size()];
+            }
+            std::vector<size_t> expected_fields;
+            std::vector<size_t> expected_records;
+            bool escaped = false;
+            bool quoted = false;
+            for (size_t i = 0; i < s.size(); ++i)
+            {
+                if (escaped)
+                {
+                    escaped = false;
+                }
+                else if (s[i] == '\\')
+                {
+                    escaped = true;
+                }
+                else if (s[i] == '"')
+                {
+                    quoted = !quoted;
+                }
+                else if (!quoted && s[i] == ',')
+                {
+                    expected_fields.push_back(i);
+                }
+                else if (!quoted && s[i] == '\n')
+                {
+                    expected_records.push_back(i);
+                }
+            }
 
-    iterator begin() const
+            std::vector<size_t> fields;
+            std::vector<size_t> records;
+            quoted_splitter splitter{s, dialect};
+            csv_record record;
+            while (splitter.next(record))
+            {
+                for (size_t i = 0; i + 1 < record.fields.size(); ++i)
+                {
+                    fields.push_back(record.fields[i].data() + record.fields[i].size() - s.data());
+                }
+                auto end = static_cast<size_t>(record.text.data() + record.text.size() - s.data());
+                if (end < s.size())
+                {
+                    records.push_back(end);
+                }
+            }
+            assert(fields == expected_fields && records == expected_records);
+        }
+    }
+#if __has_include(<unistd.h>)
+    // streaming from a pipe, through a tiny buffer: records are split between reads
     {
-        return iterator{s_, delims_};
+        int fds[2];
+        pipe(fds);
+        std::string data;
+        for (int i = 0; i < 1000; ++i)
+        {
+            data += std::to_string(i) + ",\"quoted, with a\nnewline\"," + std::string(i % 100, 'x') + "\n";
+        }
+        std::thread writer{[&] {
+            write(fds[1], data.data(), data.size());
+            close(fds[1]);
+        }};
+        chunked_record_reader reader{fds[0], {}, 64};
+        csv_record record;
+        int count = 0;
+        while (reader.next(record))
+        {
+            assert(record.fields.size() == 3 && record.fields[0] == std::to_string(count));
+            assert(record.fields[1] == "\"quoted, with a\nnewline\"" && record.fields[2].size() == count % 100u);
+            ++count;
+        }
+        assert(count == 1000);
+        writer.join();
+        close(fds[0]);
     }
-    sentinel_iterator end() const { return {}; }
-
-private:
-    std::string_view s_;
-    const char *delims_;
-};
-
-// Another ugly recurring problem is iterating over the regex matches.
-// (std::regex may be deprecated anyway (?), so maybe not such a big deal)
-#include <regex>
+    // ... written in small pieces: the same records as splitting the whole data at once
+    {
+        std::mt19937 random{11};
+        const std::string alphabet = ",\n\"\\xyz";
+        const csv_dialect dialect{.escape = '\\'};
+        std::string data;
+        for (size_t i = 0; i < 20000; ++i)
+        {
+            data += alphabet[random() % alphabet.size()];
+        }
+        std::vector<std::vector<std::string>> expected;
+        quoted_splitter splitter{data, dialect};
+        csv_record record;
+        while (splitter.next(record))
+        {
+            expected.emplace_back(record.fields.begin(), record.fields.end());
+        }
 
-struct regex_range
-{
-    regex_range(const std::regex &regex, const std::string_view &s)
-        : begin_{s.data(), s.data() + s.size(), regex}, end_{}
+        // down to no buffer at all: it's made big enough anyway
+        for (size_t buffer_size : {16, 1, 0})
+        {
+            int fds[2];
+            pipe(fds);
+            std::thread writer{[&] {
+                for (size_t i = 0; i < data.size(); i += 7)
+                {
+                    write(fds[1], data.data() + i, std::min<size_t>(7, data.size() - i));
+                }
+                close(fds[1]);
+            }};
+            chunked_record_reader reader{fds[0], dialect, buffer_size};
+            std::vector<std::vector<std::string>> streamed;
+            while (reader.next(record))
+            {
+                streamed.emplace_back(record.fields.begin(), record.fields.end());
+            }
+            writer.join();
+            close(fds[0]);
+            assert(streamed == expected);
+        }
+    }
+#endif
+    // the view doesn't have to be NUL-terminated: nothing after it is looked at
     {
+        const std::string buffer = "a,b,c" + std::string(100, 'x') + ",tail";
+        const auto view = std::string_view{buffer}.substr(0, 105);
+        auto segments = collect(split_range{view, ","});
+        assert(segments.size() == 3 && segments[2].size() == 101);
+        char_set set{","};
+        assert(set.find(buffer.data() + 4, buffer.data() + 105) == buffer.data() + 105);
+        assert(set.find(buffer.data() + 4, buffer.data() + 106) == buffer.data() + 105);
     }
-    // preventing call with a regex as a temporary value
-    regex_range(std::regex &&regex, const std::string_view &s) = delete;
+    // our own regex engine finds the same matches and submatches as `std::regex`
+    {
+        pike::regex rx_pair{"(\\d+):(\\d+)"};
+        std::vector<std::string_view> pairs;
+        for (const auto &m : pike::regex_range{rx_pair, "   1:2, 3:10, 11:20"})
+        {
+            pairs.push_back(m.str());
+            assert(m.size() == 3 && m[1].size() + m[2].size() + 1 == m.length());
+        }
+        assert((pairs == std::vector<std::string_view>{"1:2", "3:10", "11:20"}));
 
-    auto begin() const { return begin_; }
-    auto end() const { return end_; }
+        const char *patterns[] = {
+            "\\d+:\\d+", "(\\w+)=(\\d*)", "a|ab|abc", "(a+?)(b*)c", "[^,\\s]+", "x{2,3}y?", "(?:ab|a)(c|bcd)",
+            "^a+", "b$", "(a|b)*c", "[a-c0]{2}|:[=,]", "a.c", "(a)|(b)|(c)", "\\(|\\)+",
+        };
+        const std::string alphabet = "abcxy01:,= \n()";
+        std::mt19937 random{17};
+        for (auto pattern : patterns)
+        {
+            std::regex expected_rx{pattern};
+            pike::regex rx{pattern};
+            for (size_t size = 0; size < 100; ++size)
+            {
+                std::string s;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    s += alphabet[random() % alphabet.size()];
+                }
+                std::cregex_iterator expected{s.data(), s.data() + s.size(), expected_rx};
+                for (const auto &m : pike::regex_range{rx, s})
+                {
+                    assert(expected != std::cregex_iterator{});
+                    assert(m.size() == expected->size());
+                    for (size_t i = 0; i < m.size(); ++i)
+                    {
+                        assert(m.matched(i) == (*expected)[i].matched);
+                        assert(!m.matched(i) || (m.position(i) == size_t(expected->position(i)) && m[i] == (*expected)[i].str()));
+                    }
+                    ++expected;
+                }
+                assert(expected == std::cregex_iterator{});
+            }
+        }
 
-private:
-    std::cregex_iterator begin_;
-    std::cregex_iterator end_;
-};
+        // more DFA states than it keeps: the cache is dropped and filled again
+        {
+            const char *pattern = "[ab]*a[ab]{12}c";
+            std::string s;
+            for (size_t i = 0; i < 3000; ++i)
+            {
+                s += "ab"[random() % 2];
+                if (i % 500 == 499)
+                {
+                    s += 'c';
+                }
+            }
+            std::vector<std::string> expected;
+            std::regex expected_rx{pattern};
+            for (std::cregex_iterator it{s.data(), s.data() + s.size(), expected_rx}, end; it != end; ++it)
+            {
+                expected.push_back(it->str());
+            }
+            pike::regex rx{pattern};
+            std::vector<std::string> found;
+            for (const auto &m : pike::regex_range{rx, s})
+            {
+                found.emplace_back(m.str());
+            }
+            assert(!expected.empty() && found == expected);
+        }
 
-#include <iostream>
+        // long matches: submatches are found by the VM rather than by backtracking
+        {
+            const std::string s = "x" + std::string(50000, 'a') + std::string(50000, 'b') + "x";
+            pike::regex rx{"(a+?)(a*b+)|(x)"};
+            std::vector<std::string_view> found;
+            for (const auto &m : pike::regex_range{rx, s})
+            {
+                found.push_back(m.str());
+                assert(m.matched(1) == !m.matched(3));
+                assert(!m.matched(1) || (m[1] == "a" && m.position(2) == 2 && m.length(2) == 99999));
+            }
+            assert(found.size() == 3 && found[1].size() == 100000);
+        }
 
-// use:
-int main()
-{
-    // splitting
+        // one `vm` for many inputs
+        {
+            pike::vm matcher{rx_pair};
+            for (int i = 0; i < 100; ++i)
+            {
+                auto line = std::to_string(i) + ":" + std::to_string(i * i) + " x";
+                auto matches = 0;
+                for (const auto &m : pike::regex_range{matcher, line})
+                {
+                    assert(m.str() == line.substr(0, line.size() - 2) && m[1] == std::to_string(i));
+                    ++matches;
+                }
+                assert(matches == 1);
+            }
+        }
+
+        for (auto bad : {"(a", "a)", "*a", "[a", "a{3,2}", "\\", "[z-a]", "a\\b"})
+        {
+            bool thrown = false;
+            try
+            {
+                pike::regex{bad};
+            }
+            catch (const std::regex_error &)
+            {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+    }
+    // many patterns in one pass: the same as matching `(p0)|(p1)|...`
     {
-        for (const auto &sv : split_range{"   1:2, 3:10, 11:20", ",:"})
+        const std::vector<std::string> patterns = {
+            "\\d+:\\d+", "ab+", "a", "b$", "^x", "[0-9]{3}", "c(?:ab|ba)c", ":", "x?",
+        };
+        std::string alternation;
+        for (const auto &pattern : patterns)
         {
-            std::cout << sv << "\n";
+            alternation += (alternation.empty() ? "(" : "|(") + pattern + ")";
+        }
+        std::regex expected_rx{alternation};
+        pike::multi_regex rx{patterns};
+        assert(rx.size() == patterns.size());
+        pike::multi_regex without_empty{"\\d+:\\d+", "ab+", "a", "b$"};
+        pike::regex joined{"\\d+:\\d+|ab+|a|b$"};
+        const std::string alphabet = "abcx01:";
+        std::mt19937 random{23};
+        for (size_t size = 0; size < 300; ++size)
+        {
+            std::string s;
+            for (size_t i = 0; i < size; ++i)
+            {
+                s += alphabet[random() % alphabet.size()];
+            }
+            std::cregex_iterator expected{s.data(), s.data() + s.size(), expected_rx};
+            for (const auto &m : pike::multi_regex_range{rx, s})
+            {
+                assert(expected != std::cregex_iterator{});
+                assert(m.position == size_t(expected->position()) && m.text == expected->str());
+                assert((*expected)[m.pattern + 1].matched);
+                ++expected;
+            }
+            assert(expected == std::cregex_iterator{});
+
+            size_t count = 0;
+            for (const auto &m : pike::multi_regex_range{without_empty, s})
+            {
+                assert(!m.text.empty() && m.pattern < 4);
+                ++count;
+            }
+            for (const auto &m : pike::regex_range{joined, s})
+            {
+                assert(count-- > 0 && !m.str().empty());
+            }
+            assert(count == 0);
         }
     }
-    // matching
+    // patterns known at compile time
     {
-        std::regex rx_pair{"\\d+:\\d+"};
-        for (const auto &m : regex_range{rx_pair, "   1:2, 3:10, 11:20"})
+        std::vector<std::string_view> pairs;
+        for (const auto &m : rx::regex_range<"(\\d+):(\\d+)">{"   1:2, 3:10, 11:20"})
         {
-            std::cout << m.str() << "\n";
+            pairs.push_back(m.str());
+            assert(m.size() == 3 && m[1].size() + m[2].size() + 1 == m.length());
+        }
+        assert((pairs == std::vector<std::string_view>{"1:2", "3:10", "11:20"}));
+
+        // nothing to construct at runtime: it even works at compile time
+        static_assert(rx::regex<"a(b|cd)*e">::matches("abcdbe"));
+        static_assert(!rx::regex<"a(b|cd)*e">::matches("abce"));
+        static_assert([] {
+            size_t count = 0;
+            for (const auto &m : rx::regex_range<"[a-z]+">{"one, two; three"})
+            {
+                count += m.length();
+            }
+            return count;
+        }() == 11);
+
+        const std::string alphabet = "abcxy01:,= \n()";
+        std::mt19937 random{29};
+        std::vector<std::string> inputs;
+        for (size_t size = 0; size < 100; ++size)
+        {
+            std::string s;
+            for (size_t i = 0; i < size; ++i)
+            {
+                s += alphabet[random() % alphabet.size()];
+            }
+            inputs.push_back(s);
         }
+        check_compile_time_regex<"\\d+:\\d+">(inputs);
+        check_compile_time_regex<"(\\w+)=(\\d*)">(inputs);
+        check_compile_time_regex<"a|ab|abc">(inputs);
+        check_compile_time_regex<"(a+?)(b*)c">(inputs);
+        check_compile_time_regex<"[^,\\s]+">(inputs);
+        check_compile_time_regex<"x{2,3}y?">(inputs);
+        check_compile_time_regex<"(?:ab|a)(c|bcd)">(inputs);
+        check_compile_time_regex<"^a+">(inputs);
+        check_compile_time_regex<"b$">(inputs);
+        check_compile_time_regex<"(a|b)*c">(inputs);
+        check_compile_time_regex<"(a|bc){2,}?x">(inputs);
+        check_compile_time_regex<"a.c">(inputs);
+        check_compile_time_regex<"(a)|(b)|(c)">(inputs);
+        check_compile_time_regex<"x*">(inputs);
+        check_compile_time_regex<"(a*)*b">(inputs);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,2781 @@
+#pragma once
+
+#include <string_view>
+#include <cstring>
+
+// C++ makes it notoriously hard to split a string or string view into segments.
+// This is an example using `strpbrk` for delimiting.
+// Can be easily updated to use `strchr`, `strstr`, or `find`, say.
+// Note that `strpbrk` needs a NUL-terminated string, so it may run past the end of a view,
+// and it builds its table of delimiters on every call; see `split_range` below for a better version.
+struct strpbrk_split_range
+{
+    strpbrk_split_range(const std::string_view &s, const char *delims)
+        : s_(s), delims_(delims)
+    {
+    }
+
+    struct sentinel_iterator
+    {
+    };
+
+    struct iterator
+    {
+        iterator(const std::string_view &s, const char *delims)
+            : delims_{delims}, begin_{s.data()}, end_{strpbrk(begin_, delims_)}, end_of_string_{s.data() + s.size()}
+        {
+            if (!end_ || end_ > end_of_string_)
+            {
+                end_ = end_of_string_;
+            }
+        }
+        iterator &operator++()
+        {
+            if (end_ == end_of_string_)
+            {
+                // the last segment: don't look past the terminator
+                begin_ = end_of_string_;
+                return *this;
+            }
+            begin_ = end_ + 1;
+            end_ = strpbrk(begin_, delims_);
+            if (!end_ || end_ > end_of_string_)
+            {
+                end_ = end_of_string_;
+            }
+            return *this;
+        }
+        std::string_view operator*() const
+        {
+            return {begin_, static_cast<size_t>(end_ - begin_)};
+        }
+        bool operator!=(sentinel_iterator) const
+        {
+            return begin_ < end_of_string_;
+        }
+
+        //private:
+        const char *delims_;
+        const char *begin_;
+        const char *end_;
+        const char *end_of_string_;
+    };
+
+    iterator begin() const
+    {
+        return iterator{s_, delims_};
+    }
+    sentinel_iterator end() const { return {}; }
+
+private:
+    std::string_view s_;
+    const char *delims_;
+};
+
+// A set of chars, prepared once to search for any of them in a buffer (what `strpbrk` does on every call),
+// 16 or 32 bytes at a time with SSE/AVX2, and without going past the end of the buffer.
+//
+// The trick for SIMD is the "nibble table" lookup (as in Hyperscan's "shufti" or simdjson):
+// `pshufb` looks up 16 bytes at once in a 16-entry table, so a byte is split into two nibbles,
+// `lo[c & 0xF] & hi[c >> 4]` is non-zero only for chars of the set. Every distinct high nibble in the set gets
+// one bit, which limits it to 8 distinct high nibbles (plenty for delimiters: all of ASCII punctuation is in
+// just 4 of them). `pshufb` needs SSSE3 (`-mssse3`, `-mavx2`, `-march=native`), so plain SSE2 builds compare
+// with every char of the set instead, if there're few of them. Otherwise it's a 256-bit bitmap, byte by byte.
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+class char_set
+{
+public:
+#if defined(__AVX2__)
+    static constexpr size_t block_size = 32;
+#else
+    static constexpr size_t block_size = 16;
+#endif
+
+    explicit char_set(std::string_view chars)
+    {
+        uint8_t hi_bits[16] = {};
+        int distinct_hi = 0;
+        for (auto ch : chars)
+        {
+            auto c = static_cast<unsigned char>(ch);
+            if (contains(ch))
+            {
+                continue;
+            }
+            bitmap_[c / 64] |= uint64_t{1} << (c % 64);
+            if (compare_count_ < max_compare)
+            {
+                compare_[compare_count_] = ch;
+            }
+            ++compare_count_;
+            if (!hi_bits[c >> 4] && distinct_hi < 8)
+            {
+                hi_bits[c >> 4] = uint8_t(1u << distinct_hi++);
+            }
+            if (auto bit = hi_bits[c >> 4])
+            {
+                hi_[c >> 4] = bit;
+                lo_[c & 0xF] |= bit;
+            }
+            else
+            {
+                use_nibbles_ = false;
+            }
+        }
+#if defined(__SSSE3__)
+        // one or two compares are cheaper than the nibble lookup
+        if (compare_count_ <= 2)
+        {
+            mode_ = mode::compare;
+        }
+        else
+        {
+            mode_ = use_nibbles_ ? mode::nibbles : compare_count_ <= max_compare ? mode::compare : mode::bitmap;
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        mode_ = compare_count_ <= max_compare ? mode::compare : mode::bitmap;
+#endif
+    }
+
+    bool contains(char c) const
+    {
+        auto u = static_cast<unsigned char>(c);
+        return (bitmap_[u / 64] >> (u % 64)) & 1;
+    }
+
+    // Bit `i` is set if `p[i]` is in the set, for `i` < `block_size` and `p + i` < `end`.
+    // Lets the caller walk through all the matches in a block without searching again (see `split_range`).
+    uint32_t block_mask(const char *p, const char *end) const
+    {
+        if (end - p >= static_cast<ptrdiff_t>(block_size))
+        {
+            switch (mode_)
+            {
+#if defined(__SSSE3__)
+            case mode::nibbles:
+                return nibbles_mask(p);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+            case mode::compare:
+                return compare_mask(p);
+#endif
+            default:
+                break;
+            }
+        }
+        uint32_t mask = 0;
+        for (size_t i = 0; i < block_size && p + i < end; ++i)
+        {
+            mask |= uint32_t{contains(p[i])} << i;
+        }
+        return mask;
+    }
+
+    // the same for 64 bytes
+    uint64_t mask64(const char *p, const char *end) const
+    {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 64 && p + i < end; i += block_size)
+        {
+            mask |= uint64_t{block_mask(p + i, end)} << i;
+        }
+        return mask;
+    }
+
+    // first char of the set in [p, end), or `end`
+    const char *find(const char *p, const char *end) const
+    {
+        for (; p < end; p += block_size)
+        {
+            if (auto mask = block_mask(p, end))
+            {
+                return p + std::countr_zero(mask);
+            }
+        }
+        return end;
+    }
+
+private:
+#if defined(__SSSE3__)
+    uint32_t nibbles_mask(const char *p) const
+    {
+        const __m128i lo16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lo_));
+        const __m128i hi16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi_));
+#if defined(__AVX2__)
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(lo16), _mm256_and_si256(block, nibble));
+        auto hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(hi16),
+                                      _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        auto misses = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+        return ~static_cast<uint32_t>(_mm256_movemask_epi8(misses));
+#else
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto lo = _mm_shuffle_epi8(lo16, _mm_and_si128(block, nibble));
+        auto hi = _mm_shuffle_epi8(hi16, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        auto misses = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        return ~static_cast<uint32_t>(_mm_movemask_epi8(misses)) & 0xFFFF;
+#endif
+    }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    uint32_t compare_mask(const char *p) const
+    {
+#if defined(__AVX2__)
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto hits = _mm256_setzero_si256();
+        for (size_t i = 0; i < compare_count_; ++i)
+        {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(compare_[i])));
+        }
+        return static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+#else
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto hits = _mm_setzero_si128();
+        for (size_t i = 0; i < compare_count_; ++i)
+        {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(compare_[i])));
+        }
+        return static_cast<uint32_t>(_mm_movemask_epi8(hits));
+#endif
+    }
+#endif
+
+    enum class mode
+    {
+        bitmap,
+        compare,
+        nibbles,
+    };
+    static constexpr size_t max_compare = 4;
+
+    uint64_t bitmap_[4] = {};
+    uint8_t lo_[16] = {};
+    uint8_t hi_[16] = {};
+    bool use_nibbles_ = true;
+    char compare_[max_compare] = {};
+    size_t compare_count_ = 0;
+    mode mode_ = mode::bitmap;
+};
+
+// Splitting with `char_set`: the delimiters are prepared once per range, and the search is bounded by the view,
+// so it doesn't have to be NUL-terminated.
+struct split_range
+{
+    split_range(const std::string_view &s, const char *delims)
+        : s_(s), delims_(delims)
+    {
+    }
+    split_range(const std::string_view &s, const char_set &delims)
+        : s_(s), delims_(delims)
+    {
+    }
+
+    struct sentinel_iterator
+    {
+    };
+
+    // Keeps the match mask of the current block, so every block is looked at once,
+    // however many delimiters there're in it (fields are often shorter than a block).
+    struct iterator
+    {
+        iterator(const std::string_view &s, const char_set &delims)
+            : delims_{&delims}, begin_{s.data()}, end_of_string_{s.data() + s.size()},
+              block_{begin_}, mask_{delims.block_mask(block_, end_of_string_)}, end_{next_delimiter()}
+        {
+        }
+        iterator &operator++()
+        {
+            begin_ = end_ + 1;
+            end_ = begin_ < end_of_string_ ? next_delimiter() : end_of_string_;
+            return *this;
+        }
+        std::string_view operator*() const
+        {
+            return {begin_, static_cast<size_t>(end_ - begin_)};
+        }
+        bool operator!=(sentinel_iterator) const
+        {
+            return begin_ < end_of_string_;
+        }
+
+    private:
+        const char *next_delimiter()
+        {
+            while (!mask_)
+            {
+                block_ += char_set::block_size;
+                if (block_ >= end_of_string_)
+                {
+                    return end_of_string_;
+                }
+                mask_ = delims_->block_mask(block_, end_of_string_);
+            }
+            auto delimiter = block_ + std::countr_zero(mask_);
+            mask_ &= mask_ - 1;
+            return delimiter;
+        }
+
+        const char_set *delims_;
+        const char *begin_;
+        const char *end_of_string_;
+        const char *block_;
+        uint32_t mask_;
+        const char *end_;
+    };
+
+    iterator begin() const
+    {
+        return iterator{s_, delims_};
+    }
+    sentinel_iterator end() const { return {}; }
+
+private:
+    std::string_view s_;
+    char_set delims_;
+};
+
+// Bulk splitting: positions of all the delimiters at once, into a vector which can be reused.
+// Like the "structural index" of simdjson: 64 bytes at a time are turned into a bitmask, and the set bits are
+// written out 8 at a time without checking (the vector always has room for 64 more), so there's no branch per
+// delimiter. Fields are then [0, offsets[0]), [offsets[0] + 1, offsets[1]), ..., [offsets.back() + 1, s.size()).
+#include <vector>
+
+// appends positions of all the chars of `delims` in `s`, plus `base`, to `out`
+inline void append_offsets(std::string_view s, const char_set &delims, std::vector<size_t> &out, size_t base = 0)
+{
+    auto n = out.size();
+    const auto end = s.data() + s.size();
+    for (auto p = s.data(); p < end; p += 64)
+    {
+        auto mask = delims.mask64(p, end);
+        if (out.size() < n + 64)
+        {
+            out.resize(std::max(n + 64, 2 * out.size()));
+        }
+        auto count = std::popcount(mask);
+        auto position = base + (p - s.data());
+        auto dst = out.data() + n;
+        // `countr_zero(0)` is 64, so extra entries are garbage, but they're overwritten or cut off later
+        for (int i = 0; i < 8; ++i)
+        {
+            dst[i] = position + std::countr_zero(mask);
+            mask &= mask - 1;
+        }
+        for (int i = 8; i < count; ++i)
+        {
+            dst[i] = position + std::countr_zero(mask);
+            mask &= mask - 1;
+        }
+        n += count;
+    }
+    out.resize(n);
+}
+
+// `out` is replaced with positions of all the chars of `delims` in `s`
+inline void split_offsets(std::string_view s, const char_set &delims, std::vector<size_t> &out)
+{
+    out.clear();
+    append_offsets(s, delims, out);
+}
+
+// The same with a `thread_pool`, for very large buffers: every chunk is indexed into its own vector,
+// then they're concatenated (chunks are 64-byte aligned to the beginning of `s`, and delimiters are single chars,
+// so there's nothing to fix at the boundaries). Keep the `parallel_splitter` to reuse the per-chunk vectors.
+#include "thread_pool.h"
+
+struct parallel_splitter
+{
+    explicit parallel_splitter(thread_pool &pool, size_t min_chunk_size = 1024 * 1024)
+        : pool_{pool}, min_chunk_size_{min_chunk_size}
+    {
+    }
+
+    void split_offsets(std::string_view s, const char_set &delims, std::vector<size_t> &out)
+    {
+        auto chunk_count = std::max<size_t>(1, std::min(s.size() / min_chunk_size_, 4 * pool_.size()));
+        // multiple of 64, so that chunks are processed exactly as with one `append_offsets`
+        auto chunk_size = (s.size() / chunk_count + 63) / 64 * 64;
+        chunk_count = chunk_size ? (s.size() + chunk_size - 1) / chunk_size : 0;
+        chunks_.resize(chunk_count);
+        pool_.for_each_index(chunk_count, [&](size_t i) {
+            chunks_[i].clear();
+            append_offsets(s.substr(i * chunk_size, chunk_size), delims, chunks_[i], i * chunk_size);
+        });
+
+        first_.resize(chunk_count + 1);
+        first_[0] = 0;
+        for (size_t i = 0; i < chunk_count; ++i)
+        {
+            first_[i + 1] = first_[i] + chunks_[i].size();
+        }
+        out.resize(first_.back());
+        pool_.for_each_index(chunk_count, [&](size_t i) {
+            std::copy(chunks_[i].begin(), chunks_[i].end(), out.begin() + first_[i]);
+        });
+    }
+
+private:
+    thread_pool &pool_;
+    size_t min_chunk_size_;
+    std::vector<std::vector<size_t>> chunks_;
+    std::vector<size_t> first_;
+};
+
+// Splitting CSV-like data, where delimiters inside quotes (`"a,b"`) or escaped ones (`a\,b`) don't count.
+// Records and fields are views into the data, nothing is copied (and fields are returned as is, with quotes).
+//
+// Quotes are handled without a branch per char, the way simdjson does it: for 64 bytes at a time,
+// the bitmask of "inside quotes" is the prefix XOR of the bitmask of quotes (every quote flips the state),
+// which is one carry-less multiplication by all ones (or 6 shifts and XORs without PCLMUL).
+// Doubled quotes (`"say ""hi"""`) just flip the state twice. Escaped chars are found with simdjson's trick
+// for runs of backslashes (only the odd ones escape the next char), also branch-free.
+struct csv_dialect
+{
+    char field = ',';
+    char record = '\n';
+    char quote = '"';
+    // '\0' for none
+    char escape = '\0';
+};
+
+namespace quote_masks
+{
+    inline uint64_t prefix_xor(uint64_t bits)
+    {
+#if defined(__PCLMUL__)
+        auto all_ones = _mm_set1_epi8(static_cast<char>(0xFF));
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<int64_t>(bits)), all_ones, 0)));
+#else
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+#endif
+    }
+
+    // Chars escaped by the odd backslashes of every run (a backslash escapes the next char, unless it's escaped
+    // itself). `prev_escaped` carries the escape over to the next block.
+    inline uint64_t find_escaped(uint64_t backslashes, uint64_t &prev_escaped)
+    {
+        constexpr uint64_t even_bits = 0x5555555555555555;
+        backslashes &= ~prev_escaped;
+        uint64_t follows_escape = backslashes << 1 | prev_escaped;
+        // runs of backslashes starting at an odd position
+        uint64_t odd_starts = backslashes & ~even_bits & ~follows_escape;
+        // adding the start of a run to the run carries past its end
+        uint64_t sequences_starting_on_even_bits = odd_starts + backslashes;
+        prev_escaped = sequences_starting_on_even_bits < backslashes;
+        uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+        return (even_bits ^ invert_mask) & follows_escape;
+    }
+
+    class scanner
+    {
+    public:
+        explicit scanner(const csv_dialect &dialect)
+            : field_{std::string_view{&dialect.field, 1}}, record_{std::string_view{&dialect.record, 1}},
+              quote_{std::string_view{&dialect.quote, 1}}, escape_{std::string_view{&dialect.escape, 1}},
+              has_escape_{dialect.escape != '\0'}
+        {
+        }
+
+        // delimiters outside quotes in 64 bytes at `p` (blocks have to be scanned in order)
+        struct masks
+        {
+            uint64_t fields;
+            uint64_t records;
+        };
+
+        masks scan(const char *p, const char *end)
+        {
+            auto quotes = quote_.mask64(p, end);
+            auto fields = field_.mask64(p, end);
+            auto records = record_.mask64(p, end);
+            if (has_escape_)
+            {
+                auto escaped = find_escaped(escape_.mask64(p, end), prev_escaped_);
+                quotes &= ~escaped;
+                fields &= ~escaped;
+                records &= ~escaped;
+            }
+            auto inside = prefix_xor(quotes) ^ in_quotes_;
+            // all ones if the block ends inside quotes
+            in_quotes_ = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+            return {fields & ~inside, records & ~inside};
+        }
+
+    private:
+        char_set field_;
+        char_set record_;
+        char_set quote_;
+        char_set escape_;
+        bool has_escape_;
+        uint64_t in_quotes_ = 0;
+        uint64_t prev_escaped_ = 0;
+    };
+}
+
+struct csv_record
+{
+    std::string_view text;
+    // reused between records, so there're no allocations once it's big enough
+    std::vector<std::string_view> fields;
+};
+
+// Over data in memory, e.g. a memory-mapped file.
+class quoted_splitter
+{
+public:
+    // `complete` is false if the data may continue (see `chunked_record_reader`): the last record is returned
+    // only if it's terminated.
+    explicit quoted_splitter(std::string_view data, const csv_dialect &dialect = {}, bool complete = true)
+        : scanner_{dialect}, record_begin_{data.data()}, block_{data.data()}
+    {
+        set_end(data, complete);
+    }
+    explicit quoted_splitter(const char *data, const csv_dialect &dialect = {})
+        : quoted_splitter{std::string_view{data}, dialect}
+    {
+    }
+    // preventing call with a temporary string: records would point to the freed memory
+    quoted_splitter(std::string &&data, const csv_dialect &dialect = {}, bool complete = true) = delete;
+
+    // false at the end
+    bool next(csv_record &record)
+    {
+        record.fields.clear();
+        auto field_begin = record_begin_;
+        // fields of an incomplete record found before `extend`
+        for (auto offset : partial_fields_)
+        {
+            record.fields.emplace_back(field_begin, record_begin_ + offset - field_begin);
+            field_begin = record_begin_ + offset + 1;
+        }
+        partial_fields_.clear();
+        for (;;)
+        {
+            auto delimiters = masks_.fields | masks_.records;
+            if (!delimiters)
+            {
+                if (block_ >= scan_end_)
+                {
+                    break;
+                }
+                masks_ = scanner_.scan(block_, end_);
+                scanned_ = block_;
+                block_ += 64;
+                continue;
+            }
+            auto bit = delimiters & (~delimiters + 1);
+            auto delimiter = scanned_ + std::countr_zero(delimiters);
+            masks_.fields &= ~bit;
+            record.fields.emplace_back(field_begin, delimiter - field_begin);
+            field_begin = delimiter + 1;
+            if (masks_.records & bit)
+            {
+                masks_.records &= ~bit;
+                record.text = {record_begin_, static_cast<size_t>(delimiter - record_begin_)};
+                record_begin_ = delimiter + 1;
+                return true;
+            }
+        }
+        if (!complete_)
+        {
+            for (auto &field : record.fields)
+            {
+                partial_fields_.push_back(static_cast<size_t>(field.data() + field.size() - record_begin_));
+            }
+            return false;
+        }
+        // the last record without a terminator
+        if (record_begin_ >= end_)
+        {
+            return false;
+        }
+        record.fields.emplace_back(field_begin, end_ - field_begin);
+        record.text = {record_begin_, static_cast<size_t>(end_ - record_begin_)};
+        record_begin_ = end_;
+        return true;
+    }
+
+    // data after the last record returned
+    std::string_view rest() const { return {record_begin_, static_cast<size_t>(end_ - record_begin_)}; }
+
+    // More data for an incomplete splitter: `data` starts with `rest()` (possibly moved elsewhere) and continues it.
+    // What's scanned already isn't scanned again.
+    void extend(std::string_view data, bool complete)
+    {
+        block_ = data.data() + (block_ - record_begin_);
+        record_begin_ = data.data();
+        set_end(data, complete);
+    }
+
+private:
+    // While the data may continue, only whole blocks are scanned: the quote and escape state carried
+    // to the next block is only right at the end of a block.
+    void set_end(std::string_view data, bool complete)
+    {
+        end_ = data.data() + data.size();
+        complete_ = complete;
+        scan_end_ = complete ? end_ : block_ + (end_ - block_) / 64 * 64;
+    }
+
+    quote_masks::scanner scanner_;
+    const char *end_ = nullptr;
+    const char *scan_end_ = nullptr;
+    const char *record_begin_;
+    const char *block_;                             // the next block to scan
+    const char *scanned_ = nullptr;                 // the block of `masks_`
+    quote_masks::scanner::masks masks_{0, 0};
+    std::vector<size_t> partial_fields_;            // ends of fields, from `record_begin_`
+    bool complete_ = true;
+};
+
+// Over a file (or a pipe, or a socket) read in chunks into a buffer, which is reused; only an incomplete record
+// at the end of the buffer is moved to its beginning. The record can't be bigger than the buffer: the buffer
+// grows then. Records are valid until the next call.
+#if __has_include(<unistd.h>)
+#include <cerrno>
+#include <optional>
+#include <system_error>
+#include <unistd.h>
+
+class chunked_record_reader
+{
+public:
+    explicit chunked_record_reader(int fd, const csv_dialect &dialect = {}, size_t buffer_size = 1 << 20)
+        : fd_{fd}, dialect_{dialect}, buffer_(std::max<size_t>(buffer_size, 1))
+    {
+    }
+
+    bool next(csv_record &record)
+    {
+        for (;;)
+        {
+            if (splitter_ && splitter_->next(record))
+            {
+                return true;
+            }
+            if (eof_)
+            {
+                return false;
+            }
+            refill();
+        }
+    }
+
+private:
+    void refill()
+    {
+        // an incomplete record is moved to the beginning, the splitter goes on from where it stopped
+        size_t kept = 0;
+        if (splitter_)
+        {
+            auto rest = splitter_->rest();
+            kept = rest.size();
+            std::memmove(buffer_.data(), rest.data(), kept);
+        }
+        if (kept == buffer_.size())
+        {
+            buffer_.resize(2 * buffer_.size());
+        }
+        // one `read`: a pipe gives what it has, and that's processed right away
+        auto filled = kept;
+        for (;;)
+        {
+            auto n = ::read(fd_, buffer_.data() + filled, buffer_.size() - filled);
+            if (n >= 0)
+            {
+                filled += static_cast<size_t>(n);
+                eof_ = n == 0;
+                break;
+            }
+            if (errno != EINTR)
+            {
+                throw std::system_error(errno, std::system_category(), "read");
+            }
+        }
+        std::string_view data{buffer_.data(), filled};
+        if (splitter_)
+        {
+            splitter_->extend(data, eof_);
+        }
+        else
+        {
+            splitter_.emplace(data, dialect_, eof_);
+        }
+    }
+
+    int fd_;
+    csv_dialect dialect_;
+    std::vector<char> buffer_;
+    std::optional<quoted_splitter> splitter_;
+    bool eof_ = false;
+};
+#endif
+
+// Another ugly recurring problem is iterating over the regex matches.
+// (std::regex may be deprecated anyway (?), so maybe not such a big deal)
+#include <regex>
+
+struct regex_range
+{
+    regex_range(const std::regex &regex, const std::string_view &s)
+        : begin_{s.data(), s.data() + s.size(), regex}, end_{}
+    {
+    }
+    // preventing call with a regex as a temporary value
+    regex_range(std::regex &&regex, const std::string_view &s) = delete;
+
+    auto begin() const { return begin_; }
+    auto end() const { return end_; }
+
+private:
+    std::cregex_iterator begin_;
+    std::cregex_iterator end_;
+};
+
+#include <array>
+#include <climits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// `std::regex` is slow (it's a backtracking interpreter of a node graph) and allocates on every match,
+// so here's a small engine of our own, with the same kind of range of matches: `pike::regex` compiles a pattern
+// into a program for a Pike VM (see https://swtch.com/~rsc/regexp/regexp2.html), which runs all the alternatives
+// in lockstep: linear time, no backtracking, and leftmost-first submatches (as in Perl or ECMAScript).
+// Most of the work is done by DFAs made from the same program on the fly (see `vm` below), as in RE2.
+// Matches and submatches are `string_view`s; the memory is allocated once per range, not per match.
+// Positions where a match can't start are skipped with `char_set` (the set of first bytes of the pattern).
+//
+// Supported: literals, `.` (anything but '\n'), `[...]`/`[^...]` with ranges, `\d \w \s \D \W \S`, escapes,
+// `^ $` (beginning/end of the input), groups `(...)` and `(?:...)`, `|`, and `* + ? {n} {n,} {n,m}`,
+// greedy or lazy (`*?` etc). Errors are reported with `std::regex_error`, as `std::regex` does.
+namespace pike
+{
+    struct byte_class
+    {
+        uint64_t bits[4] = {};
+
+        constexpr bool contains(unsigned char c) const { return (bits[c / 64] >> (c % 64)) & 1; }
+        constexpr void add(unsigned char c) { bits[c / 64] |= uint64_t{1} << (c % 64); }
+        constexpr void add(const byte_class &other)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                bits[i] |= other.bits[i];
+            }
+        }
+        constexpr void negate()
+        {
+            for (auto &b : bits)
+            {
+                b = ~b;
+            }
+        }
+    };
+
+    enum class op : uint8_t
+    {
+        byte,   // `arg` is the byte
+        any,    // anything but '\n'
+        klass,  // `arg` is an index in `classes`
+        split,  // continue at `arg` (preferred) and `arg2`
+        jump,   // `arg`
+        save,   // `arg` is the capture slot
+        line_begin,
+        line_end,
+        match,
+    };
+
+    struct instruction
+    {
+        op code;
+        uint32_t arg = 0;
+        uint32_t arg2 = 0;
+    };
+
+    struct program
+    {
+        std::vector<instruction> code;
+        std::vector<byte_class> classes;
+        // 2 per group, group 0 is the whole match
+        size_t slots = 2;
+        // bytes a match can start with; empty if the pattern can match an empty string
+        std::string first_bytes;
+    };
+
+    namespace details
+    {
+        // parses into a tree first, since repetitions `{n,m}` need the code of their operand emitted many times
+        struct node
+        {
+            enum kind_t
+            {
+                empty,
+                byte,
+                any,
+                klass,
+                concat,
+                alternate,
+                repeat,
+                group,
+                line_begin,
+                line_end,
+            } kind;
+            uint32_t value = 0;  // byte, class index or group index
+            int min = 0;
+            int max = 0;  // -1 for unbounded
+            bool greedy = true;
+            std::vector<size_t> children = {};
+        };
+
+        constexpr int max_repeat = 1000;
+
+        class parser
+        {
+        public:
+            constexpr parser(std::string_view pattern, program &prog)
+                : pattern_{pattern}, prog_{prog}
+            {
+            }
+
+            constexpr size_t parse()
+            {
+                auto root = parse_alternate();
+                if (pos_ != pattern_.size())
+                {
+                    throw std::regex_error{std::regex_constants::error_paren};
+                }
+                return root;
+            }
+
+            std::vector<node> nodes;
+
+        private:
+            constexpr size_t add(node n)
+            {
+                nodes.push_back(std::move(n));
+                return nodes.size() - 1;
+            }
+
+            constexpr bool at_end() const { return pos_ == pattern_.size(); }
+            constexpr char peek() const { return pattern_[pos_]; }
+
+            constexpr size_t parse_alternate()
+            {
+                node alt{node::alternate};
+                alt.children.push_back(parse_concat());
+                while (!at_end() && peek() == '|')
+                {
+                    ++pos_;
+                    alt.children.push_back(parse_concat());
+                }
+                return alt.children.size() == 1 ? alt.children[0] : add(std::move(alt));
+            }
+
+            constexpr size_t parse_concat()
+            {
+                node seq{node::concat};
+                while (!at_end() && peek() != '|' && peek() != ')')
+                {
+                    seq.children.push_back(parse_repeat());
+                }
+                return add(std::move(seq));
+            }
+
+            constexpr size_t parse_repeat()
+            {
+                auto atom = parse_atom();
+                while (!at_end())
+                {
+                    int min = 0;
+                    int max = -1;
+                    auto c = peek();
+                    if (c == '*' || c == '+' || c == '?')
+                    {
+                        min = c == '+' ? 1 : 0;
+                        max = c == '?' ? 1 : -1;
+                        ++pos_;
+                    }
+                    else if (c == '{' && parse_braces(min, max))
+                    {
+                    }
+                    else
+                    {
+                        break;
+                    }
+                    auto kind = nodes[atom].kind;
+                    if (kind == node::line_begin || kind == node::line_end)
+                    {
+                        throw std::regex_error{std::regex_constants::error_badrepeat};
+                    }
+                    node rep{node::repeat};
+                    rep.min = min;
+                    rep.max = max;
+                    if (!at_end() && peek() == '?')
+                    {
+                        rep.greedy = false;
+                        ++pos_;
+                    }
+                    rep.children.push_back(atom);
+                    atom = add(std::move(rep));
+                }
+                return atom;
+            }
+
+            // `{n}`, `{n,}` or `{n,m}`; anything else is a literal '{'
+            constexpr bool parse_braces(int &min, int &max)
+            {
+                auto p = pos_ + 1;
+                auto number = [&](int &value) {
+                    auto start = p;
+                    value = 0;
+                    for (; p < pattern_.size() && '0' <= pattern_[p] && pattern_[p] <= '9'; ++p)
+                    {
+                        value = std::min(value * 10 + (pattern_[p] - '0'), max_repeat + 1);
+                    }
+                    return p != start;
+                };
+                if (!number(min))
+                {
+                    return false;
+                }
+                max = min;
+                if (p < pattern_.size() && pattern_[p] == ',')
+                {
+                    ++p;
+                    if (!number(max))
+                    {
+                        max = -1;
+                    }
+                }
+                if (p >= pattern_.size() || pattern_[p] != '}')
+                {
+                    return false;
+                }
+                if (min > max_repeat || max > max_repeat || (max != -1 && max < min))
+                {
+                    throw std::regex_error{std::regex_constants::error_badbrace};
+                }
+                pos_ = p + 1;
+                return true;
+            }
+
+            constexpr size_t parse_atom()
+            {
+                auto c = pattern_[pos_++];
+                switch (c)
+                {
+                case '(':
+                {
+                    node g{node::group};
+                    if (pattern_.substr(pos_, 2) == "?:")
+                    {
+                        pos_ += 2;
+                        g.kind = node::concat;
+                    }
+                    else
+                    {
+                        g.value = static_cast<uint32_t>(prog_.slots / 2);
+                        prog_.slots += 2;
+                    }
+                    g.children.push_back(parse_alternate());
+                    if (at_end() || peek() != ')')
+                    {
+                        throw std::regex_error{std::regex_constants::error_paren};
+                    }
+                    ++pos_;
+                    return add(std::move(g));
+                }
+                case '.':
+                    return add({node::any});
+                case '^':
+                    return add({node::line_begin});
+                case '$':
+                    return add({node::line_end});
+                case '[':
+                    return add_class(parse_class());
+                case '\\':
+                {
+                    byte_class klass;
+                    if (parse_escape(klass))
+                    {
+                        return add_class(klass);
+                    }
+                    return add({node::byte, escaped_});
+                }
+                case '*':
+                case '+':
+                case '?':
+                    throw std::regex_error{std::regex_constants::error_badrepeat};
+                default:
+                    return add({node::byte, static_cast<unsigned char>(c)});
+                }
+            }
+
+            constexpr size_t add_class(const byte_class &klass)
+            {
+                prog_.classes.push_back(klass);
+                return add({node::klass, static_cast<uint32_t>(prog_.classes.size() - 1)});
+            }
+
+            // after '\\': true for a class (`\d` etc.), false for a single byte (in `escaped_`)
+            constexpr bool parse_escape(byte_class &klass)
+            {
+                if (at_end())
+                {
+                    throw std::regex_error{std::regex_constants::error_escape};
+                }
+                auto c = pattern_[pos_++];
+                auto lower = static_cast<char>(c | 0x20);
+                if (lower == 'd' || lower == 'w' || lower == 's')
+                {
+                    for (unsigned b = 0; b < 256; ++b)
+                    {
+                        bool digit = '0' <= b && b <= '9';
+                        bool in = lower == 'd'   ? digit
+                                  : lower == 'w' ? digit || b == '_' || ('a' <= (b | 0x20) && (b | 0x20) <= 'z')
+                                                 : b == ' ' || ('\t' <= b && b <= '\r');
+                        if (in)
+                        {
+                            klass.add(static_cast<unsigned char>(b));
+                        }
+                    }
+                    if (c != lower)
+                    {
+                        klass.negate();
+                    }
+                    return true;
+                }
+                switch (c)
+                {
+                case 'n': escaped_ = '\n'; break;
+                case 't': escaped_ = '\t'; break;
+                case 'r': escaped_ = '\r'; break;
+                case 'f': escaped_ = '\f'; break;
+                case 'v': escaped_ = '\v'; break;
+                case '0': escaped_ = '\0'; break;
+                default:
+                    if (('a' <= lower && lower <= 'z') || ('0' <= c && c <= '9'))
+                    {
+                        // not supported (`\b`, back references...) rather than silently matching a letter
+                        throw std::regex_error{std::regex_constants::error_escape};
+                    }
+                    escaped_ = static_cast<unsigned char>(c);
+                }
+                return false;
+            }
+
+            constexpr byte_class parse_class()
+            {
+                byte_class klass;
+                bool negate = !at_end() && peek() == '^';
+                if (negate)
+                {
+                    ++pos_;
+                }
+                for (bool first = true;; first = false)
+                {
+                    if (at_end())
+                    {
+                        throw std::regex_error{std::regex_constants::error_brack};
+                    }
+                    auto c = pattern_[pos_++];
+                    if (c == ']' && !first)
+                    {
+                        break;
+                    }
+                    unsigned char from = static_cast<unsigned char>(c);
+                    if (c == '\\')
+                    {
+                        byte_class escaped_class;
+                        if (parse_escape(escaped_class))
+                        {
+                            klass.add(escaped_class);
+                            continue;
+                        }
+                        from = static_cast<unsigned char>(escaped_);
+                    }
+                    unsigned char to = from;
+                    if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']')
+                    {
+                        ++pos_;
+                        auto last = pattern_[pos_++];
+                        to = static_cast<unsigned char>(last);
+                        if (last == '\\')
+                        {
+                            byte_class escaped_class;
+                            if (parse_escape(escaped_class))
+                            {
+                                throw std::regex_error{std::regex_constants::error_range};
+                            }
+                            to = static_cast<unsigned char>(escaped_);
+                        }
+                        if (to < from)
+                        {
+                            throw std::regex_error{std::regex_constants::error_range};
+                        }
+                    }
+                    for (unsigned b = from; b <= to; ++b)
+                    {
+                        klass.add(static_cast<unsigned char>(b));
+                    }
+                }
+                if (negate)
+                {
+                    klass.negate();
+                }
+                return klass;
+            }
+
+            std::string_view pattern_;
+            program &prog_;
+            size_t pos_ = 0;
+            uint32_t escaped_ = 0;
+        };
+
+        class compiler
+        {
+        public:
+            // `reversed` is for matching backwards, from the end of a match to its beginning
+            compiler(const std::vector<node> &nodes, program &prog, bool reversed)
+                : nodes_{nodes}, code_{prog.code}, reversed_{reversed}
+            {
+            }
+
+            void emit(size_t index)
+            {
+                const auto &n = nodes_[index];
+                switch (n.kind)
+                {
+                case node::empty:
+                    break;
+                case node::byte:
+                    code_.push_back({op::byte, n.value});
+                    break;
+                case node::any:
+                    code_.push_back({op::any});
+                    break;
+                case node::klass:
+                    code_.push_back({op::klass, n.value});
+                    break;
+                case node::line_begin:
+                    code_.push_back({reversed_ ? op::line_end : op::line_begin});
+                    break;
+                case node::line_end:
+                    code_.push_back({reversed_ ? op::line_begin : op::line_end});
+                    break;
+                case node::concat:
+                    if (reversed_)
+                    {
+                        std::for_each(n.children.rbegin(), n.children.rend(), [this](size_t child) { emit(child); });
+                    }
+                    else
+                    {
+                        for (auto child : n.children)
+                        {
+                            emit(child);
+                        }
+                    }
+                    break;
+                case node::group:
+                    code_.push_back({op::save, 2 * n.value});
+                    emit(n.children[0]);
+                    code_.push_back({op::save, 2 * n.value + 1});
+                    break;
+                case node::alternate:
+                {
+                    // split L1, next; L1: a; jump end; next: split L2, next2; ...
+                    std::vector<size_t> jumps;
+                    for (size_t i = 0; i + 1 < n.children.size(); ++i)
+                    {
+                        auto split = code_.size();
+                        code_.push_back({op::split, static_cast<uint32_t>(split + 1)});
+                        emit(n.children[i]);
+                        jumps.push_back(code_.size());
+                        code_.push_back({op::jump});
+                        code_[split].arg2 = static_cast<uint32_t>(code_.size());
+                    }
+                    emit(n.children.back());
+                    for (auto jump : jumps)
+                    {
+                        code_[jump].arg = static_cast<uint32_t>(code_.size());
+                    }
+                    break;
+                }
+                case node::repeat:
+                {
+                    for (int i = 0; i < n.min; ++i)
+                    {
+                        emit(n.children[0]);
+                    }
+                    if (n.max == -1)
+                    {
+                        // loop: split body, end; body; jump loop
+                        auto split = code_.size();
+                        code_.push_back({op::split});
+                        emit(n.children[0]);
+                        code_.push_back({op::jump, static_cast<uint32_t>(split)});
+                        branch(split, split + 1, code_.size(), n.greedy);
+                    }
+                    else
+                    {
+                        // x{0,3} is (x(x(x)?)?)?
+                        std::vector<size_t> splits;
+                        for (int i = n.min; i < n.max; ++i)
+                        {
+                            splits.push_back(code_.size());
+                            code_.push_back({op::split});
+                            emit(n.children[0]);
+                        }
+                        for (auto split : splits)
+                        {
+                            branch(split, split + 1, code_.size(), n.greedy);
+                        }
+                    }
+                    break;
+                }
+                }
+            }
+
+        private:
+            void branch(size_t split, size_t body, size_t end, bool greedy)
+            {
+                code_[split].arg = static_cast<uint32_t>(greedy ? body : end);
+                code_[split].arg2 = static_cast<uint32_t>(greedy ? end : body);
+            }
+
+            const std::vector<node> &nodes_;
+            std::vector<instruction> &code_;
+            bool reversed_;
+        };
+
+        // bytes which can be consumed first, or false if the program can match without consuming anything
+        inline bool first_bytes(const program &prog, byte_class &result)
+        {
+            std::vector<bool> seen(prog.code.size());
+            std::vector<uint32_t> stack{0};
+            while (!stack.empty())
+            {
+                auto pc = stack.back();
+                stack.pop_back();
+                if (seen[pc])
+                {
+                    continue;
+                }
+                seen[pc] = true;
+                const auto &inst = prog.code[pc];
+                switch (inst.code)
+                {
+                case op::byte:
+                    result.add(static_cast<unsigned char>(inst.arg));
+                    break;
+                case op::any:
+                    return false;
+                case op::klass:
+                    result.add(prog.classes[inst.arg]);
+                    break;
+                case op::split:
+                    stack.push_back(inst.arg);
+                    stack.push_back(inst.arg2);
+                    break;
+                case op::jump:
+                    stack.push_back(inst.arg);
+                    break;
+                case op::save:
+                case op::line_begin:
+                case op::line_end:
+                    stack.push_back(pc + 1);
+                    break;
+                case op::match:
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    namespace details
+    {
+        // appends `save 0, <pattern>, save 1, match <id>`
+        inline void add_pattern(program &prog, std::string_view pattern, bool reversed, uint32_t id)
+        {
+            parser parser{pattern, prog};
+            auto root = parser.parse();
+            prog.code.push_back({op::save, 0});
+            compiler{parser.nodes, prog, reversed}.emit(root);
+            prog.code.push_back({op::save, 1});
+            prog.code.push_back({op::match, id});
+        }
+
+        inline void set_first_bytes(program &prog)
+        {
+            byte_class first;
+            if (first_bytes(prog, first))
+            {
+                for (unsigned b = 0; b < 256; ++b)
+                {
+                    if (first.contains(static_cast<unsigned char>(b)))
+                    {
+                        prog.first_bytes += static_cast<char>(b);
+                    }
+                }
+            }
+        }
+    }
+
+    inline program compile(std::string_view pattern, bool reversed = false)
+    {
+        program prog;
+        details::add_pattern(prog, pattern, reversed, 0);
+        if (!reversed)
+        {
+            details::set_first_bytes(prog);
+        }
+        return prog;
+    }
+
+    // `p0|p1|...`, where `match` tells which one it is
+    template<typename PatternsT>
+    program compile_set(const PatternsT &patterns)
+    {
+        program prog;
+        uint32_t id = 0;
+        size_t split = SIZE_MAX;
+        for (const auto &pattern : patterns)
+        {
+            if (split != SIZE_MAX)
+            {
+                prog.code[split].arg2 = static_cast<uint32_t>(prog.code.size());
+            }
+            split = prog.code.size();
+            prog.code.push_back({op::split, static_cast<uint32_t>(split + 1)});
+            details::add_pattern(prog, pattern, false, id++);
+        }
+        if (split == SIZE_MAX)
+        {
+            throw std::invalid_argument{"no patterns"};
+        }
+        // the last one doesn't need a split
+        prog.code[split] = {op::jump, static_cast<uint32_t>(split + 1)};
+        details::set_first_bytes(prog);
+        return prog;
+    }
+
+    class regex
+    {
+    public:
+        explicit regex(std::string_view pattern)
+            : program_{compile(pattern)}, reversed_{compile(pattern, true)}, first_bytes_{program_.first_bytes}
+        {
+        }
+
+        const program &get_program() const { return program_; }
+        const program &get_reversed_program() const { return reversed_; }
+        const char_set &first_bytes() const { return first_bytes_; }
+        bool has_prefilter() const { return !program_.first_bytes.empty(); }
+        // number of groups, including the whole match
+        size_t groups() const { return program_.slots / 2; }
+
+    private:
+        program program_;
+        program reversed_;
+        char_set first_bytes_;
+    };
+
+    // A DFA built from a program on the fly: a state is the ordered list of the VM's threads (instructions which
+    // consume a byte, `match`, and `$` waiting for the end of the input) without their captures, so it's only good
+    // for finding where matches end. States and transitions are made when they're first needed and then cached;
+    // if there're too many states, the cache is dropped and filled again.
+    class lazy_dfa
+    {
+    public:
+        enum mode_t
+        {
+            // unanchored, and the threads after a match are cut off: the end of the leftmost-first match
+            leftmost_first,
+            // anchored, and all the threads keep running: the end of the longest match
+            longest,
+        };
+
+        lazy_dfa(const program &prog, mode_t mode)
+            : prog_{prog}, mode_{mode}, visited_(prog.code.size())
+        {
+            new_list();
+            closure(0, false, false);
+            no_start_ = list_.empty();
+            make_key(false);
+            start_key_ = key_;
+        }
+
+        // the state at the position a walk starts from; `at_begin` if it's where `^` matches
+        int32_t start(bool at_begin)
+        {
+            auto &state = starts_[at_begin];
+            if (state < 0)
+            {
+                new_list();
+                closure(0, at_begin, false);
+                state = intern(false);
+            }
+            return state;
+        }
+
+        int32_t next(int32_t state, unsigned char byte)
+        {
+            auto target = transitions_[state * 256 + byte];
+            return target >= 0 ? target : add_transition(state, byte);
+        }
+
+        // a match ends right before the byte the walk is at
+        bool is_match(int32_t state) const { return flags_[state] & match_flag; }
+        // nothing more can match
+        bool is_dead(int32_t state) const { return flags_[state] & dead_flag; }
+        // nothing is running but the new thread, so the walk can skip to a byte a match can start with
+        bool is_start(int32_t state) const { return flags_[state] & start_flag; }
+
+        // which pattern the match is for (see `multi_regex`), -1 if it's not a match
+        int32_t pattern(int32_t state) const { return states_[state].pattern; }
+
+        // the pattern which matches at the end of the input (where `$` matches), or -1
+        int32_t pattern_at_end(int32_t state, bool at_begin)
+        {
+            if (!at_begin && states_[state].at_end != unknown)
+            {
+                return states_[state].at_end;
+            }
+            new_list();
+            const auto offset = states_[state].offset;
+            const auto size = states_[state].size;
+            for (uint32_t i = offset; i < offset + size; ++i)
+            {
+                auto pc = pcs_[i];
+                if (prog_.code[pc].code == op::line_end)
+                {
+                    closure(pc + 1, at_begin, true);
+                }
+                else if (prog_.code[pc].code == op::match)
+                {
+                    list_.push_back(pc);
+                }
+            }
+            auto result = first_match();
+            if (!at_begin)
+            {
+                states_[state].at_end = result;
+            }
+            return result;
+        }
+
+        // In `leftmost_first` mode: walks from `from` to the end of the leftmost-first match, skipping to the bytes
+        // in `first_bytes` (if any) while nothing is running. Returns the end (or nullptr) and the pattern.
+        const char *find_end(const char *begin, const char *from, const char *end, const char_set *first_bytes,
+                             int32_t &matched)
+        {
+            const char *match_end = nullptr;
+            auto p = from;
+            for (auto state = start(p == begin);; state = next(state, static_cast<unsigned char>(*p++)))
+            {
+                // the hot loop: most states need nothing but the next transition
+                while (flags_[state] == 0 && p != end)
+                {
+                    state = next(state, static_cast<unsigned char>(*p++));
+                }
+                if (is_match(state))
+                {
+                    match_end = p;
+                    matched = pattern(state);
+                }
+                if (is_dead(state))
+                {
+                    break;
+                }
+                if (first_bytes && is_start(state) && prefilter_pays_off())
+                {
+                    auto candidate = first_bytes->find(p, end);
+                    ++prefilter_calls_;
+                    prefilter_skipped_ += candidate - p;
+                    p = candidate;
+                }
+                if (p == end)
+                {
+                    if (auto at_end = pattern_at_end(state, p == begin); at_end >= 0)
+                    {
+                        match_end = end;
+                        matched = at_end;
+                    }
+                    break;
+                }
+            }
+            return match_end;
+        }
+
+        // In `longest` mode, with the reversed program: walks back from `match_end` (but not past `from`)
+        // to the beginning of the longest match. That's where the leftmost match ending there begins.
+        const char *find_begin(const char *begin, const char *from, const char *match_end, const char *end)
+        {
+            const char *match_begin = nullptr;
+            auto p = match_end;
+            for (auto state = start(p == end);; state = next(state, static_cast<unsigned char>(*--p)))
+            {
+                if (is_match(state))
+                {
+                    match_begin = p;
+                }
+                if (is_dead(state))
+                {
+                    break;
+                }
+                if (p == from)
+                {
+                    if (p == begin && pattern_at_end(state, match_end == end && p == match_end) >= 0)
+                    {
+                        match_begin = begin;
+                    }
+                    break;
+                }
+            }
+            return match_begin;
+        }
+
+    private:
+        // Skipping costs more than it saves if the first bytes are all over the input, like digits in a list
+        // of numbers: then the prefilter is turned off (for good, the input is likely to stay like that).
+        bool prefilter_pays_off() const
+        {
+            return prefilter_calls_ < 32 || prefilter_skipped_ >= 8 * prefilter_calls_;
+        }
+
+        // 256 transitions take 1KB, so this is 2MB at most
+        static constexpr size_t max_states = 2048;
+
+        enum : uint8_t
+        {
+            match_flag = 1,
+            dead_flag = 2,
+            start_flag = 4,
+        };
+
+        static constexpr int32_t unknown = -2;
+
+        struct state
+        {
+            uint32_t offset;  // in `pcs_`
+            uint32_t size;
+            bool found;  // a match was seen already, so no new threads are started
+            int32_t pattern = -1;
+            int32_t at_end = unknown;  // `pattern_at_end`
+        };
+
+        int32_t add_transition(int32_t from, unsigned char byte)
+        {
+            new_list();
+            const auto offset = states_[from].offset;
+            const auto size = states_[from].size;
+            const auto found = states_[from].found;
+            for (uint32_t i = offset; i < offset + size; ++i)
+            {
+                auto pc = pcs_[i];
+                const auto &inst = prog_.code[pc];
+                bool step = inst.code == op::byte       ? inst.arg == byte
+                            : inst.code == op::any      ? byte != '\n'
+                            : inst.code == op::klass    ? prog_.classes[inst.arg].contains(byte)
+                                                        : false;
+                if (step)
+                {
+                    closure(pc + 1, false, false);
+                }
+            }
+            if (mode_ == leftmost_first && !found)
+            {
+                closure(0, false, false);
+            }
+            auto resets = resets_;
+            auto target = intern(found);
+            if (resets == resets_)
+            {
+                // otherwise `from` is gone with the rest of the cache
+                transitions_[from * 256 + byte] = target;
+            }
+            return target;
+        }
+
+        int32_t intern(bool found)
+        {
+            if (mode_ == leftmost_first)
+            {
+                auto match = std::find_if(list_.begin(), list_.end(),
+                                          [this](uint32_t pc) { return prog_.code[pc].code == op::match; });
+                if (match != list_.end())
+                {
+                    // lower priority threads can't win anymore
+                    list_.erase(match + 1, list_.end());
+                    found = true;
+                }
+            }
+            make_key(found);
+            if (auto it = index_.find(key_); it != index_.end())
+            {
+                return it->second;
+            }
+            if (states_.size() == max_states)
+            {
+                index_.clear();
+                states_.clear();
+                flags_.clear();
+                pcs_.clear();
+                transitions_.clear();
+                starts_ = {-1, -1};
+                ++resets_;
+            }
+            uint8_t flags = 0;
+            auto matched = first_match();
+            flags |= matched >= 0 ? match_flag : 0;
+            flags |= list_.empty() && (found || mode_ == longest || no_start_) ? dead_flag : 0;
+            flags |= mode_ == leftmost_first && key_ == start_key_ ? start_flag : 0;
+            auto index = static_cast<int32_t>(states_.size());
+            states_.push_back({static_cast<uint32_t>(pcs_.size()), static_cast<uint32_t>(list_.size()), found, matched});
+            flags_.push_back(flags);
+            pcs_.insert(pcs_.end(), list_.begin(), list_.end());
+            transitions_.resize(transitions_.size() + 256, -1);
+            index_.emplace(key_, index);
+            return index;
+        }
+
+        void make_key(bool found)
+        {
+            key_.assign(1, found);
+            key_.append(reinterpret_cast<const char *>(list_.data()), list_.size() * sizeof(uint32_t));
+        }
+
+        // the pattern of the `match` with the highest priority in `list_`, or -1
+        int32_t first_match() const
+        {
+            auto match = std::find_if(list_.begin(), list_.end(),
+                                      [this](uint32_t pc) { return prog_.code[pc].code == op::match; });
+            return match != list_.end() ? static_cast<int32_t>(prog_.code[*match].arg) : -1;
+        }
+
+        void new_list()
+        {
+            list_.clear();
+            if (++stamp_ == 0)
+            {
+                std::fill(visited_.begin(), visited_.end(), 0);
+                stamp_ = 1;
+            }
+        }
+
+        // adds the threads reachable from `pc` without consuming anything to `list_`, in priority order
+        void closure(uint32_t pc, bool at_begin, bool at_end)
+        {
+            stack_.push_back(pc);
+            while (!stack_.empty())
+            {
+                pc = stack_.back();
+                stack_.pop_back();
+                if (visited_[pc] == stamp_)
+                {
+                    continue;
+                }
+                visited_[pc] = stamp_;
+                const auto &inst = prog_.code[pc];
+                switch (inst.code)
+                {
+                case op::jump:
+                    stack_.push_back(inst.arg);
+                    break;
+                case op::split:
+                    stack_.push_back(inst.arg2);
+                    stack_.push_back(inst.arg);
+                    break;
+                case op::save:
+                    stack_.push_back(pc + 1);
+                    break;
+                case op::line_begin:
+                    if (at_begin)
+                    {
+                        stack_.push_back(pc + 1);
+                    }
+                    break;
+                case op::line_end:
+                    if (at_end)
+                    {
+                        stack_.push_back(pc + 1);
+                    }
+                    else
+                    {
+                        list_.push_back(pc);
+                    }
+                    break;
+                default:
+                    list_.push_back(pc);
+                    break;
+                }
+            }
+        }
+
+        const program &prog_;
+        mode_t mode_;
+        bool no_start_ = false;
+        std::string start_key_;
+
+        std::vector<state> states_;
+        std::vector<uint8_t> flags_;  // apart from `states_`, to keep the hot loop's memory small
+        std::vector<uint32_t> pcs_;
+        std::vector<int32_t> transitions_;
+        std::unordered_map<std::string, int32_t> index_;
+        std::array<int32_t, 2> starts_ = {-1, -1};
+        size_t resets_ = 0;
+        size_t prefilter_calls_ = 0;
+        size_t prefilter_skipped_ = 0;
+
+        // scratch
+        std::vector<uint32_t> list_;
+        std::string key_;
+        std::vector<uint32_t> stack_;
+        std::vector<uint32_t> visited_;
+        uint32_t stamp_ = 0;
+    };
+
+    // Runs a regex, the way RE2 does: the DFA finds where the match ends, the DFA of the reversed program
+    // (walking backwards from there) finds where it starts, and only then, if there're groups, the Pike VM
+    // finds the submatches, looking at the match only. All of them are linear, and the DFAs are fast.
+    // The memory is allocated once and reused for all the matches (apart from DFA states, which are cached).
+    class vm
+    {
+    public:
+        explicit vm(const regex &rx)
+            : rx_{rx}, prog_{rx.get_program()}, size_{prog_.code.size()}, slots_{prog_.slots},
+              forward_{prog_, lazy_dfa::leftmost_first}, backward_{rx.get_reversed_program(), lazy_dfa::longest},
+              current_{size_, slots_}, next_{size_, slots_}, captures_(slots_), matched_(slots_),
+              visited_(slots_ > 2 ? max_visited / 64 : 0)
+        {
+            stack_.reserve(3 * size_ + slots_);
+        }
+
+        // Leftmost match in `input` starting at `from` or later; the submatches are in `captures()`.
+        bool search(std::string_view input, size_t from)
+        {
+            const auto begin = input.data();
+            const auto end = begin + input.size();
+
+            int32_t pattern = 0;
+            const auto first_bytes = rx_.has_prefilter() ? &rx_.first_bytes() : nullptr;
+            const auto match_end = forward_.find_end(begin, begin + from, end, first_bytes, pattern);
+            if (!match_end)
+            {
+                return false;
+            }
+            const auto match_begin = backward_.find_begin(begin, begin + from, match_end, end);
+
+            if (slots_ == 2)
+            {
+                matched_[0] = match_begin;
+                matched_[1] = match_end;
+            }
+            else if (size_ * (match_end - match_begin + 1) <= max_visited)
+            {
+                backtrack(begin, match_begin, match_end, end);
+            }
+            else
+            {
+                find_submatches(begin, match_begin, match_end, end);
+            }
+            return true;
+        }
+
+        // valid after a successful `search`: begin and end of every group (nullptr if it didn't participate)
+        const std::vector<const char *> &captures() const { return matched_; }
+
+    private:
+        // bits for the backtracker: (instruction, position) pairs it has been at
+        static constexpr size_t max_visited = 256 * 1024;
+
+        // For short matches, plain backtracking is faster than the VM (it doesn't copy captures around),
+        // and it's still linear: the same instruction at the same position is never tried twice
+        // (RE2's "bit state"). Alternatives are tried in priority order, so the first match is the right one.
+        void backtrack(const char *begin, const char *from, const char *to, const char *end)
+        {
+            const size_t width = to - from + 1;
+            std::fill_n(visited_.begin(), (size_ * width + 63) / 64, 0);
+            std::fill(captures_.begin(), captures_.end(), nullptr);
+            stack_.push_back({frame::explore, 0, from});
+            while (!stack_.empty())
+            {
+                auto f = stack_.back();
+                stack_.pop_back();
+                if (f.kind == frame::restore)
+                {
+                    captures_[f.pc_or_slot] = f.old_value;
+                    continue;
+                }
+                auto pc = f.pc_or_slot;
+                auto p = f.old_value;
+                for (;;)
+                {
+                    auto bit = pc * width + (p - from);
+                    if ((visited_[bit / 64] >> (bit % 64)) & 1)
+                    {
+                        break;
+                    }
+                    visited_[bit / 64] |= uint64_t{1} << (bit % 64);
+                    const auto &inst = prog_.code[pc];
+                    bool next = true;
+                    switch (inst.code)
+                    {
+                    case op::byte:
+                        next = p != to && static_cast<unsigned char>(*p) == inst.arg;
+                        p += next;
+                        break;
+                    case op::any:
+                        next = p != to && *p != '\n';
+                        p += next;
+                        break;
+                    case op::klass:
+                        next = p != to && prog_.classes[inst.arg].contains(static_cast<unsigned char>(*p));
+                        p += next;
+                        break;
+                    case op::split:
+                        stack_.push_back({frame::explore, inst.arg2, p});
+                        pc = inst.arg - 1;
+                        break;
+                    case op::jump:
+                        pc = inst.arg - 1;
+                        break;
+                    case op::save:
+                        stack_.push_back({frame::restore, inst.arg, captures_[inst.arg]});
+                        captures_[inst.arg] = p;
+                        break;
+                    case op::line_begin:
+                        next = p == begin;
+                        break;
+                    case op::line_end:
+                        next = p == end;
+                        break;
+                    case op::match:
+                        std::copy(captures_.begin(), captures_.end(), matched_.begin());
+                        stack_.clear();
+                        return;
+                    }
+                    if (!next)
+                    {
+                        break;
+                    }
+                    ++pc;
+                }
+            }
+        }
+
+        // the Pike VM proper, for a match which is known to be [from, to)
+        void find_submatches(const char *begin, const char *from, const char *to, const char *end)
+        {
+            begin_ = begin;
+            current_.clear();
+            std::fill(captures_.begin(), captures_.end(), nullptr);
+            add_thread(current_, 0, from, end);
+            for (auto p = from; !current_.empty(); ++p)
+            {
+                next_.clear();
+                for (size_t i = 0; i < current_.size(); ++i)
+                {
+                    auto pc = current_.pc(i);
+                    const auto &inst = prog_.code[pc];
+                    auto thread_captures = current_.captures(i);
+                    if (inst.code == op::match)
+                    {
+                        std::copy(thread_captures, thread_captures + slots_, matched_.begin());
+                        // threads with lower priority are cut off
+                        break;
+                    }
+                    // (zero-width instructions are in the list too, only to mark them as visited)
+                    bool step = p != to
+                                && (inst.code == op::byte    ? static_cast<unsigned char>(*p) == inst.arg
+                                    : inst.code == op::any   ? *p != '\n'
+                                    : inst.code == op::klass ? prog_.classes[inst.arg].contains(static_cast<unsigned char>(*p))
+                                                             : false);
+                    if (step)
+                    {
+                        std::copy(thread_captures, thread_captures + slots_, captures_.begin());
+                        add_thread(next_, pc + 1, p + 1, end);
+                    }
+                }
+                std::swap(current_, next_);
+                if (p == to)
+                {
+                    break;
+                }
+            }
+        }
+
+        // a sparse set of program counters, in priority order, with their captures
+        class thread_list
+        {
+        public:
+            thread_list(size_t size, size_t slots)
+                : slots_{slots}, dense_(size), sparse_(size), captures_(size * slots)
+            {
+            }
+            bool contains(uint32_t pc) const { return sparse_[pc] < count_ && dense_[sparse_[pc]] == pc; }
+            void add(uint32_t pc, const std::vector<const char *> &captures)
+            {
+                sparse_[pc] = static_cast<uint32_t>(count_);
+                dense_[count_] = pc;
+                std::copy(captures.begin(), captures.end(), captures_.begin() + count_ * slots_);
+                ++count_;
+            }
+            // marks a zero-width instruction as visited, without storing anything
+            void visit(uint32_t pc)
+            {
+                sparse_[pc] = static_cast<uint32_t>(count_);
+                dense_[count_] = pc;
+                ++count_;
+            }
+            size_t size() const { return count_; }
+            bool empty() const { return count_ == 0; }
+            uint32_t pc(size_t i) const { return dense_[i]; }
+            const char *const *captures(size_t i) const { return captures_.data() + i * slots_; }
+            void clear() { count_ = 0; }
+
+        private:
+            size_t slots_;
+            size_t count_ = 0;
+            std::vector<uint32_t> dense_;
+            std::vector<uint32_t> sparse_;
+            std::vector<const char *> captures_;
+        };
+
+        struct frame
+        {
+            enum
+            {
+                explore,
+                restore,
+            } kind;
+            uint32_t pc_or_slot;
+            const char *old_value;
+        };
+
+        // Follows jumps, splits, saves and assertions from `pc` (with `captures_` as they are now), adding
+        // instructions which consume a byte (and `match`) to `list` in priority order.
+        void add_thread(thread_list &list, uint32_t pc, const char *p, const char *end)
+        {
+            stack_.push_back({frame::explore, pc, nullptr});
+            while (!stack_.empty())
+            {
+                auto f = stack_.back();
+                stack_.pop_back();
+                if (f.kind == frame::restore)
+                {
+                    captures_[f.pc_or_slot] = f.old_value;
+                    continue;
+                }
+                pc = f.pc_or_slot;
+                if (list.contains(pc))
+                {
+                    continue;
+                }
+                const auto &inst = prog_.code[pc];
+                switch (inst.code)
+                {
+                case op::jump:
+                    list.visit(pc);
+                    stack_.push_back({frame::explore, inst.arg, nullptr});
+                    break;
+                case op::split:
+                    list.visit(pc);
+                    // the preferred branch is explored first
+                    stack_.push_back({frame::explore, inst.arg2, nullptr});
+                    stack_.push_back({frame::explore, inst.arg, nullptr});
+                    break;
+                case op::save:
+                    list.visit(pc);
+                    stack_.push_back({frame::restore, inst.arg, captures_[inst.arg]});
+                    captures_[inst.arg] = p;
+                    stack_.push_back({frame::explore, pc + 1, nullptr});
+                    break;
+                case op::line_begin:
+                    list.visit(pc);
+                    if (p == begin_)
+                    {
+                        stack_.push_back({frame::explore, pc + 1, nullptr});
+                    }
+                    break;
+                case op::line_end:
+                    list.visit(pc);
+                    if (p == end)
+                    {
+                        stack_.push_back({frame::explore, pc + 1, nullptr});
+                    }
+                    break;
+                default:
+                    list.add(pc, captures_);
+                    break;
+                }
+            }
+        }
+
+        const regex &rx_;
+        const program &prog_;
+        size_t size_;
+        size_t slots_;
+        lazy_dfa forward_;
+        lazy_dfa backward_;
+        thread_list current_;
+        thread_list next_;
+        std::vector<const char *> captures_;
+        std::vector<const char *> matched_;
+        std::vector<frame> stack_;
+        std::vector<uint64_t> visited_;
+        const char *begin_ = nullptr;
+    };
+
+    class match
+    {
+    public:
+        explicit match(const std::vector<const char *> &captures)
+            : captures_{&captures}
+        {
+        }
+
+        size_t size() const { return captures_->size() / 2; }
+        // the group didn't participate in the match
+        bool matched(size_t group = 0) const { return (*captures_)[2 * group] != nullptr; }
+        std::string_view str(size_t group = 0) const
+        {
+            auto begin = (*captures_)[2 * group];
+            auto end = (*captures_)[2 * group + 1];
+            return begin ? std::string_view{begin, static_cast<size_t>(end - begin)} : std::string_view{};
+        }
+        std::string_view operator[](size_t group) const { return str(group); }
+        size_t length(size_t group = 0) const { return str(group).size(); }
+        // from the beginning of the input
+        size_t position(size_t group = 0) const { return (*captures_)[2 * group] - input_begin_; }
+
+    private:
+        friend class regex_range;
+        const std::vector<const char *> *captures_;
+        const char *input_begin_ = nullptr;
+    };
+
+    // Like `regex_range`: all non-overlapping matches, left to right. Matches are valid until the next one.
+    // Matching many short strings, pass the same `vm` to all the ranges: its memory and DFA states are reused.
+    class regex_range
+    {
+    public:
+        regex_range(const regex &rx, std::string_view input)
+            : own_vm_{std::in_place, rx}, vm_{*own_vm_}, input_{input}
+        {
+        }
+        // preventing call with a regex as a temporary value
+        regex_range(regex &&rx, std::string_view input) = delete;
+        regex_range(vm &matcher, std::string_view input)
+            : vm_{matcher}, input_{input}
+        {
+        }
+        // `vm_` may refer to `own_vm_` (and iterators to the range itself)
+        regex_range(const regex_range &) = delete;
+        regex_range &operator=(const regex_range &) = delete;
+
+        struct sentinel
+        {
+        };
+
+        class iterator
+        {
+        public:
+            explicit iterator(regex_range &r)
+                : range_{&r}, match_{r.vm_.captures()}
+            {
+                match_.input_begin_ = r.input_.data();
+                find(0);
+            }
+            const match &operator*() const { return match_; }
+            const match *operator->() const { return &match_; }
+            iterator &operator++()
+            {
+                auto begin = match_.position();
+                auto end = begin + match_.length();
+                // an empty match: the next one has to start further
+                find(end == begin ? end + 1 : end);
+                return *this;
+            }
+            bool operator!=(sentinel) const { return !done_; }
+            bool operator==(sentinel) const { return done_; }
+
+        private:
+            void find(size_t from)
+            {
+                done_ = from > range_->input_.size() || !range_->vm_.search(range_->input_, from);
+            }
+
+            regex_range *range_;
+            match match_;
+            bool done_ = false;
+        };
+
+        iterator begin() { return iterator{*this}; }
+        sentinel end() const { return {}; }
+
+    private:
+        std::optional<vm> own_vm_;
+        vm &vm_;
+        std::string_view input_;
+    };
+
+    // Many patterns in one program, to find the matches of all of them in one pass.
+    class multi_regex
+    {
+    public:
+        template<typename PatternsT>
+        explicit multi_regex(const PatternsT &patterns)
+            : program_{compile_set(patterns)}, first_bytes_{program_.first_bytes}
+        {
+            for (const auto &pattern : patterns)
+            {
+                reversed_.push_back(compile(pattern, true));
+            }
+        }
+        multi_regex(std::initializer_list<std::string_view> patterns)
+            : multi_regex(std::vector<std::string_view>(patterns))
+        {
+        }
+
+        size_t size() const { return reversed_.size(); }
+        const program &get_program() const { return program_; }
+        const program &get_reversed_program(size_t pattern) const { return reversed_[pattern]; }
+        const char_set &first_bytes() const { return first_bytes_; }
+        bool has_prefilter() const { return !program_.first_bytes.empty(); }
+
+    private:
+        program program_;
+        std::vector<program> reversed_;
+        char_set first_bytes_;
+    };
+
+    struct multi_match
+    {
+        size_t pattern;  // index in the `multi_regex`
+        std::string_view text;
+        size_t position;  // from the beginning of the input
+    };
+
+    // Like `vm` for a `multi_regex`: finds the leftmost match of any of the patterns.
+    class multi_vm
+    {
+    public:
+        explicit multi_vm(const multi_regex &rx)
+            : rx_{rx}, forward_{rx.get_program(), lazy_dfa::leftmost_first}
+        {
+            backward_.reserve(rx.size());
+            for (size_t i = 0; i < rx.size(); ++i)
+            {
+                backward_.emplace_back(rx.get_reversed_program(i), lazy_dfa::longest);
+            }
+        }
+
+        bool search(std::string_view input, size_t from, multi_match &match)
+        {
+            const auto begin = input.data();
+            const auto end = begin + input.size();
+            int32_t pattern = -1;
+            const auto first_bytes = rx_.has_prefilter() ? &rx_.first_bytes() : nullptr;
+            const auto match_end = forward_.find_end(begin, begin + from, end, first_bytes, pattern);
+            if (!match_end)
+            {
+                return false;
+            }
+            // the leftmost match overall is the leftmost one of this pattern
+            const auto match_begin = backward_[pattern].find_begin(begin, begin + from, match_end, end);
+            match = {static_cast<size_t>(pattern), {match_begin, static_cast<size_t>(match_end - match_begin)},
+                     static_cast<size_t>(match_begin - begin)};
+            return true;
+        }
+
+    private:
+        const multi_regex &rx_;
+        lazy_dfa forward_;
+        std::vector<lazy_dfa> backward_;
+    };
+
+    // Matches of any of the patterns, left to right, scanning the input once (rather than once per pattern).
+    // The same matches as `regex_range` with `p0|p1|...` gives: they don't overlap, the leftmost one wins,
+    // and of the ones starting at the same position, the pattern which is listed first.
+    class multi_regex_range
+    {
+    public:
+        multi_regex_range(const multi_regex &rx, std::string_view input)
+            : own_vm_{std::in_place, rx}, vm_{*own_vm_}, input_{input}
+        {
+        }
+        // preventing call with a regex as a temporary value
+        multi_regex_range(multi_regex &&rx, std::string_view input) = delete;
+        multi_regex_range(multi_vm &matcher, std::string_view input)
+            : vm_{matcher}, input_{input}
+        {
+        }
+        // `vm_` may refer to `own_vm_` (and iterators to the range itself)
+        multi_regex_range(const multi_regex_range &) = delete;
+        multi_regex_range &operator=(const multi_regex_range &) = delete;
+
+        struct sentinel
+        {
+        };
+
+        class iterator
+        {
+        public:
+            explicit iterator(multi_regex_range &r)
+                : range_{&r}
+            {
+                find(0);
+            }
+            const multi_match &operator*() const { return match_; }
+            const multi_match *operator->() const { return &match_; }
+            iterator &operator++()
+            {
+                auto end = match_.position + match_.text.size();
+                // an empty match: the next one has to start further
+                find(match_.text.empty() ? end + 1 : end);
+                return *this;
+            }
+            bool operator!=(sentinel) const { return !done_; }
+            bool operator==(sentinel) const { return done_; }
+
+        private:
+            void find(size_t from)
+            {
+                done_ = from > range_->input_.size() || !range_->vm_.search(range_->input_, from, match_);
+            }
+
+            multi_regex_range *range_;
+            multi_match match_{};
+            bool done_ = false;
+        };
+
+        iterator begin() { return iterator{*this}; }
+        sentinel end() const { return {}; }
+
+    private:
+        std::optional<multi_vm> own_vm_;
+        multi_vm &vm_;
+        std::string_view input_;
+    };
+}
+
+// For patterns known at compile time, like `ctre` (https://github.com/hanickadot/compile-time-regular-expressions):
+// the pattern is a template argument, parsed (by the parser of `pike`) while compiling, and every node of it
+// becomes a function, so the matcher is just inlined code, with nothing to construct or interpret at runtime:
+//
+//  for (const auto &m : rx::regex_range<"(\\d+):(\\d+)">{input})
+//  {
+//      use(m[1], m[2]);
+//  }
+//
+// It's a backtracking matcher (what `std::regex` and `ctre` do), with the same leftmost-first submatches
+// as `pike`, but no linear time guarantee: something like `(a*)*b` over a long run of 'a's is exponential,
+// and repetitions of anything but a single byte recurse once per iteration. Repetitions of a single byte
+// (`\d+`, `[^,]*`) are plain loops. Works in constant expressions too.
+namespace rx
+{
+    // a string literal as a template argument
+    template<size_t N>
+    struct fixed_string
+    {
+        char data[N] = {};
+
+        constexpr fixed_string(const char (&s)[N])
+        {
+            std::copy(s, s + N, data);
+        }
+        constexpr std::string_view view() const { return {data, N - 1}; }
+    };
+
+    namespace details
+    {
+        using node_kind = pike::details::node::kind_t;
+
+        // `pike::details::node` without the vector, for keeping in a constant
+        struct node
+        {
+            node_kind kind = node_kind::empty;
+            uint32_t value = 0;
+            int min = 0;
+            int max = 0;
+            bool greedy = true;
+            uint32_t first = 0;  // in `children`
+            uint32_t count = 0;
+        };
+
+        struct tree_sizes
+        {
+            size_t nodes = 0;
+            size_t children = 0;
+            size_t classes = 0;
+        };
+
+        template<size_t Nodes, size_t Children, size_t Classes>
+        struct tree
+        {
+            std::array<node, Nodes> nodes{};
+            std::array<uint32_t, Children> children{};
+            std::array<pike::byte_class, Classes> classes{};
+            uint32_t root = 0;
+            size_t groups = 0;  // including the whole match
+            // bytes a match can start with, if it can't be empty
+            pike::byte_class first_bytes{};
+            bool has_first_bytes = false;
+            int single_first_byte = -1;
+        };
+
+        constexpr tree_sizes measure(std::string_view pattern)
+        {
+            pike::program prog;
+            pike::details::parser parser{pattern, prog};
+            parser.parse();
+            tree_sizes sizes{parser.nodes.size(), 0, prog.classes.size()};
+            for (const auto &n : parser.nodes)
+            {
+                sizes.children += n.children.size();
+            }
+            return sizes;
+        }
+
+        // bytes which can be first in a match of `index`, and whether it can be empty instead
+        template<typename TreeT>
+        constexpr bool first_bytes(const TreeT &t, uint32_t index, pike::byte_class &result)
+        {
+            const auto &n = t.nodes[index];
+            switch (n.kind)
+            {
+            case node_kind::byte:
+                result.add(static_cast<unsigned char>(n.value));
+                return false;
+            case node_kind::any:
+                for (unsigned b = 0; b < 256; ++b)
+                {
+                    if (b != '\n')
+                    {
+                        result.add(static_cast<unsigned char>(b));
+                    }
+                }
+                return false;
+            case node_kind::klass:
+                result.add(t.classes[n.value]);
+                return false;
+            case node_kind::concat:
+                for (uint32_t i = 0; i < n.count; ++i)
+                {
+                    if (!first_bytes(t, t.children[n.first + i], result))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            case node_kind::alternate:
+            {
+                bool nullable = false;
+                for (uint32_t i = 0; i < n.count; ++i)
+                {
+                    nullable |= first_bytes(t, t.children[n.first + i], result);
+                }
+                return nullable;
+            }
+            case node_kind::repeat:
+                return first_bytes(t, t.children[n.first], result) || n.min == 0;
+            case node_kind::group:
+                return first_bytes(t, t.children[n.first], result);
+            default:
+                return true;
+            }
+        }
+
+        template<fixed_string Pattern>
+        constexpr auto make_tree()
+        {
+            constexpr auto sizes = measure(Pattern.view());
+            tree<sizes.nodes, sizes.children, sizes.classes> result;
+
+            pike::program prog;
+            pike::details::parser parser{Pattern.view(), prog};
+            result.root = static_cast<uint32_t>(parser.parse());
+            result.groups = prog.slots / 2;
+            uint32_t children = 0;
+            for (size_t i = 0; i < parser.nodes.size(); ++i)
+            {
+                const auto &n = parser.nodes[i];
+                result.nodes[i] = {n.kind, n.value, n.min, n.max, n.greedy, children, static_cast<uint32_t>(n.children.size())};
+                for (auto child : n.children)
+                {
+                    result.children[children++] = static_cast<uint32_t>(child);
+                }
+            }
+            for (size_t i = 0; i < prog.classes.size(); ++i)
+            {
+                result.classes[i] = prog.classes[i];
+            }
+
+            result.has_first_bytes = !first_bytes(result, result.root, result.first_bytes);
+            int count = 0;
+            for (unsigned b = 0; result.has_first_bytes && b < 256; ++b)
+            {
+                if (result.first_bytes.contains(static_cast<unsigned char>(b)))
+                {
+                    result.single_first_byte = count++ == 0 ? static_cast<int>(b) : -1;
+                }
+            }
+            return result;
+        }
+    }
+
+    template<fixed_string Pattern>
+    class regex;
+
+    // Submatches of a match, like `pike::match`.
+    template<size_t Groups>
+    class match
+    {
+    public:
+        constexpr size_t size() const { return Groups; }
+        constexpr bool matched(size_t group = 0) const { return captures_[2 * group] != nullptr; }
+        constexpr std::string_view str(size_t group = 0) const
+        {
+            auto begin = captures_[2 * group];
+            auto end = captures_[2 * group + 1];
+            return begin ? std::string_view{begin, static_cast<size_t>(end - begin)} : std::string_view{};
+        }
+        constexpr std::string_view operator[](size_t group) const { return str(group); }
+        constexpr size_t length(size_t group = 0) const { return str(group).size(); }
+        constexpr size_t position(size_t group = 0) const { return captures_[2 * group] - input_begin_; }
+
+    private:
+        template<fixed_string>
+        friend class regex;
+        std::array<const char *, 2 * Groups> captures_{};
+        const char *input_begin_ = nullptr;
+    };
+
+    template<fixed_string Pattern>
+    class regex
+    {
+        static constexpr auto tree = details::make_tree<Pattern>();
+
+    public:
+        using match_type = match<tree.groups>;
+
+        // Leftmost match in `input` starting at `from` or later.
+        static constexpr bool search(std::string_view input, size_t from, match_type &m)
+        {
+            context c{input.data(), input.data() + input.size(), m.captures_};
+            m.input_begin_ = c.begin;
+            m.captures_ = {};
+            for (auto p = c.begin + from;; ++p)
+            {
+                p = skip(p, c.end);
+                if (p == c.end && tree.has_first_bytes)
+                {
+                    return false;
+                }
+                m.captures_[0] = p;
+                if (match_node<tree.root>(c, p, [&c](const char *q) {
+                        c.captures[1] = q;
+                        return true;
+                    }))
+                {
+                    return true;
+                }
+                if (p == c.end)
+                {
+                    m.captures_[0] = nullptr;
+                    return false;
+                }
+            }
+        }
+
+        // the whole of `input` matches
+        static constexpr bool matches(std::string_view input)
+        {
+            match_type m;
+            context c{input.data(), input.data() + input.size(), m.captures_};
+            return match_node<tree.root>(c, c.begin, [&c](const char *q) { return q == c.end; });
+        }
+
+    private:
+        struct context
+        {
+            const char *begin;
+            const char *end;
+            std::array<const char *, 2 * tree.groups> &captures;
+        };
+
+        // to a byte a match can start with
+        static constexpr const char *skip(const char *p, const char *end)
+        {
+            if constexpr (tree.single_first_byte >= 0)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    auto found = static_cast<const char *>(std::memchr(p, tree.single_first_byte, end - p));
+                    return found ? found : end;
+                }
+            }
+            if constexpr (tree.has_first_bytes)
+            {
+                while (p != end && !tree.first_bytes.contains(static_cast<unsigned char>(*p)))
+                {
+                    ++p;
+                }
+            }
+            return p;
+        }
+
+        template<uint32_t I>
+        static constexpr bool single_byte(char c)
+        {
+            constexpr auto n = tree.nodes[I];
+            if constexpr (n.kind == details::node_kind::byte)
+            {
+                return static_cast<unsigned char>(c) == n.value;
+            }
+            else if constexpr (n.kind == details::node_kind::any)
+            {
+                return c != '\n';
+            }
+            else
+            {
+                return tree.classes[n.value].contains(static_cast<unsigned char>(c));
+            }
+        }
+
+        // Matches node `I` at `p`, and then the rest of the pattern: `next` is called with the end of every
+        // way to match the node, in priority order, until it returns true.
+        template<uint32_t I, typename NextT>
+        static constexpr bool match_node(context &c, const char *p, const NextT &next)
+        {
+            constexpr auto n = tree.nodes[I];
+            using details::node_kind;
+            if constexpr (n.kind == node_kind::byte || n.kind == node_kind::any || n.kind == node_kind::klass)
+            {
+                return p != c.end && single_byte<I>(*p) && next(p + 1);
+            }
+            else if constexpr (n.kind == node_kind::line_begin)
+            {
+                return p == c.begin && next(p);
+            }
+            else if constexpr (n.kind == node_kind::line_end)
+            {
+                return p == c.end && next(p);
+            }
+            else if constexpr (n.kind == node_kind::concat)
+            {
+                return match_sequence<I, 0>(c, p, next);
+            }
+            else if constexpr (n.kind == node_kind::alternate)
+            {
+                return match_alternatives<I, 0>(c, p, next);
+            }
+            else if constexpr (n.kind == node_kind::group)
+            {
+                auto &open = c.captures[2 * n.value];
+                auto old_open = open;
+                open = p;
+                if (match_node<tree.children[n.first]>(c, p, [&c, &next](const char *q) {
+                        auto &close = c.captures[2 * n.value + 1];
+                        auto old_close = close;
+                        close = q;
+                        if (next(q))
+                        {
+                            return true;
+                        }
+                        close = old_close;
+                        return false;
+                    }))
+                {
+                    return true;
+                }
+                open = old_open;
+                return false;
+            }
+            else if constexpr (n.kind == node_kind::repeat)
+            {
+                return match_repeat<I>(c, p, 0, next);
+            }
+            else
+            {
+                return next(p);
+            }
+        }
+
+        template<uint32_t I, uint32_t K, typename NextT>
+        static constexpr bool match_sequence(context &c, const char *p, const NextT &next)
+        {
+            constexpr auto n = tree.nodes[I];
+            if constexpr (K == n.count)
+            {
+                return next(p);
+            }
+            else
+            {
+                return match_node<tree.children[n.first + K]>(
+                    c, p, [&c, &next](const char *q) { return match_sequence<I, K + 1>(c, q, next); });
+            }
+        }
+
+        template<uint32_t I, uint32_t K, typename NextT>
+        static constexpr bool match_alternatives(context &c, const char *p, const NextT &next)
+        {
+            constexpr auto n = tree.nodes[I];
+            if constexpr (K == n.count)
+            {
+                return false;
+            }
+            else
+            {
+                return match_node<tree.children[n.first + K]>(c, p, next) || match_alternatives<I, K + 1>(c, p, next);
+            }
+        }
+
+        template<uint32_t I, typename NextT>
+        static constexpr bool match_repeat(context &c, const char *p, int count, const NextT &next)
+        {
+            constexpr auto n = tree.nodes[I];
+            constexpr auto child = tree.children[n.first];
+            constexpr auto child_kind = tree.nodes[child].kind;
+            constexpr int max = n.max < 0 ? INT_MAX : n.max;
+            if constexpr (child_kind == details::node_kind::byte || child_kind == details::node_kind::any
+                          || child_kind == details::node_kind::klass)
+            {
+                // a loop: see how far the byte repeats, then try the rest from every length, in priority order
+                auto q = p;
+                int k = 0;
+                auto limit = n.greedy ? max : n.min;
+                for (; k < limit && q != c.end && single_byte<child>(*q); ++k, ++q)
+                {
+                }
+                if (k < n.min)
+                {
+                    return false;
+                }
+                if constexpr (n.greedy)
+                {
+                    for (;; --k, --q)
+                    {
+                        if (next(q))
+                        {
+                            return true;
+                        }
+                        if (k == n.min)
+                        {
+                            return false;
+                        }
+                    }
+                }
+                else
+                {
+                    for (;; ++k, ++q)
+                    {
+                        if (next(q))
+                        {
+                            return true;
+                        }
+                        if (k == max || q == c.end || !single_byte<child>(*q))
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                auto again = [&c, p, count, &next](const char *q) {
+                    // an empty iteration doesn't get anywhere, once the minimum is there
+                    return (q != p || count < n.min) && match_repeat<I>(c, q, count + 1, next);
+                };
+                if (count < n.min)
+                {
+                    return match_node<child>(c, p, again);
+                }
+                if constexpr (n.greedy)
+                {
+                    return (count < max && match_node<child>(c, p, again)) || next(p);
+                }
+                else
+                {
+                    return next(p) || (count < max && match_node<child>(c, p, again));
+                }
+            }
+        }
+    };
+
+    // Like `regex_range` and `pike::regex_range`; the regex is the type.
+    template<fixed_string Pattern>
+    class regex_range
+    {
+    public:
+        using match_type = typename regex<Pattern>::match_type;
+
+        explicit constexpr regex_range(std::string_view input)
+            : input_{input}
+        {
+        }
+
+        struct sentinel
+        {
+        };
+
+        class iterator
+        {
+        public:
+            explicit constexpr iterator(std::string_view input)
+                : input_{input}
+            {
+                find(0);
+            }
+            constexpr const match_type &operator*() const { return match_; }
+            constexpr const match_type *operator->() const { return &match_; }
+            constexpr iterator &operator++()
+            {
+                auto begin = match_.position();
+                auto end = begin + match_.length();
+                // an empty match: the next one has to start further
+                find(end == begin ? end + 1 : end);
+                return *this;
+            }
+            constexpr bool operator!=(sentinel) const { return !done_; }
+            constexpr bool operator==(sentinel) const { return done_; }
+
+        private:
+            constexpr void find(size_t from)
+            {
+                done_ = from > input_.size() || !regex<Pattern>::search(input_, from, match_);
+            }
+
+            std::string_view input_;
+            match_type match_;
+            bool done_ = false;
+        };
+
+        constexpr iterator begin() const { return iterator{input_}; }
+        constexpr sentinel end() const { return {}; }
+
+    private:
+        std::string_view input_;
+    };
+}
@@ -0,0 +1,118 @@
+#include "thread_pool.h"
+#include "generators.h"
+
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// a sequential producer for `parallel_for_each`
+$generator(numbers, int(int)) {
+    int i;
+    $start;
+    for (i = 0; i < arg<0>(); ++i) {
+        $yield(i);
+    }
+    $stop;
+};
+
+// some CPU work, uneven: every 100th item is 100 times heavier
+unsigned work(int n)
+{
+    unsigned hash = n;
+    for (int i = 0, rounds = n % 100 == 0 ? 10000 : 100; i < rounds; ++i)
+    {
+        hash = hash * 2654435761u + 1;
+    }
+    return hash;
+}
+
+int main()
+{
+    thread_pool pool{4};
+    assert(pool.size() == 4);
+
+    // every index exactly once
+    std::vector<int> visited(1000);
+    pool.for_each_index(visited.size(), [&](size_t i) { visited[i]++; });
+    assert(std::count(visited.begin(), visited.end(), 1) == 1000);
+
+    // the pool is reused: many small loops
+    std::atomic<size_t> sum{0};
+    for (size_t n = 0; n < 100; ++n)
+    {
+        pool.for_each_index(n, [&](size_t i) { sum += i; });
+    }
+    assert(sum == 161700);  // sum of n * (n - 1) / 2 for n < 100
+
+    // exceptions get to the caller, and the pool still works afterwards
+    bool thrown = false;
+    try
+    {
+        pool.for_each_index(100, [](size_t i) {
+            if (i == 42)
+            {
+                throw std::runtime_error{"42"};
+            }
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    size_t count = 0;
+    auto increment = [&](size_t) { ++count; };
+    thread_pool{1}.for_each_index(10, increment);  // no workers: runs inline
+    assert(count == 10);
+    pool.for_each_index(10, [&](size_t) { sum++; });
+    assert(sum == 161710);
+
+    // a generator consumed by the pool: every item exactly once
+    std::fill(visited.begin(), visited.end(), 0);
+    std::atomic<unsigned> hashes{0};
+    parallel_for_each(pool, numbers{1000}, [&](int n) {
+        visited[n]++;
+        hashes += work(n);
+    });
+    assert(std::count(visited.begin(), visited.end(), 1) == 1000);
+    unsigned expected = 0;
+    for (int n = 0; n < 1000; ++n)
+    {
+        expected += work(n);
+    }
+    assert(hashes == expected);
+
+    // results in the order of the items, whatever the order they're computed in
+    std::vector<std::string> results;
+    parallel_for_each_ordered(pool, numbers{1000}, [](int n) { return std::to_string(work(n)); },
+                              [&](std::string s) { results.push_back(std::move(s)); }, 7);
+    assert(results.size() == 1000);
+    for (int n = 0; n < 1000; ++n)
+    {
+        assert(results[n] == std::to_string(work(n)));
+    }
+
+    // any range works, and a temporary pool too
+    std::vector<std::string> words{"a", "bb", "ccc"};
+    std::atomic<size_t> letters{0};
+    parallel_for_each(words, [&](const std::string& word) { letters += word.size(); }, 2);
+    assert(letters == 6 && words[2] == "ccc");  // an lvalue range: items are copied, not moved
+
+    // exceptions stop the loop and get to the caller
+    thrown = false;
+    try
+    {
+        parallel_for_each(pool, numbers{1000}, [](int n) {
+            if (n == 500)
+            {
+                throw std::runtime_error{"500"};
+            }
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
@@ -0,0 +1,351 @@
+#pragma once
+
+// The simplest thread pool that's useful for data-parallel loops: threads are started once,
+// and `for_each_index` runs a loop body on all of them (and the calling thread), returning when it's done.
+//
+// Use:
+//  thread_pool pool{4};  // the calling thread + 3 workers
+//  pool.for_each_index(chunks.size(), [&](size_t i) { process(chunks[i]); });
+//
+// Indices are handed out one at a time from an atomic counter, so uneven chunks are balanced automatically
+// (as long as there're a few times more chunks than threads).
+// One loop at a time: concurrent calls from different threads wait for each other,
+// and calling `for_each_index` from inside the loop body deadlocks.
+//
+// `parallel_for_each(pool, range, func)` is the same for a sequential range, e.g. a generator (see below).
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class thread_pool
+{
+public:
+    // `threads` includes the calling thread, so `thread_pool{1}` runs everything inline.
+    explicit thread_pool(size_t threads = std::thread::hardware_concurrency())
+    {
+        for (size_t i = 1; i < threads; ++i)
+        {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        job_posted.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    // Calls `func(i)` for every `i` in [0, count). The first exception thrown by `func` is rethrown here
+    // (the remaining indices are skipped).
+    template<typename FuncT>
+    void for_each_index(size_t count, FuncT&& func)
+    {
+        std::lock_guard one_job{job_mutex};
+        using func_type = std::remove_reference_t<FuncT>;
+        current = job{[](void* f, size_t i) { (*static_cast<func_type*>(f))(i); },
+                      const_cast<void*>(static_cast<const void*>(&func)), count};
+        next_index.store(0, std::memory_order_relaxed);
+        {
+            std::lock_guard lock{mutex};
+            ++generation;
+            busy = workers.size();
+        }
+        job_posted.notify_all();
+
+        run_job();
+
+        std::unique_lock lock{mutex};
+        job_done.wait(lock, [this] { return busy == 0; });
+        if (auto error = std::exchange(first_error, nullptr))
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    // type-erased loop body: no `std::function`, so nothing is allocated per loop
+    struct job
+    {
+        void (*call)(void*, size_t) = nullptr;
+        void* func = nullptr;
+        size_t count = 0;
+    };
+
+    void run_job()
+    {
+        for (auto i = next_index.fetch_add(1, std::memory_order_relaxed); i < current.count;
+             i = next_index.fetch_add(1, std::memory_order_relaxed))
+        {
+            try
+            {
+                current.call(current.func, i);
+            }
+            catch (...)
+            {
+                std::lock_guard lock{mutex};
+                if (!first_error)
+                {
+                    first_error = std::current_exception();
+                }
+                // nobody takes any more indices
+                next_index.store(current.count, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void work()
+    {
+        size_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock lock{mutex};
+                job_posted.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+            run_job();
+            std::lock_guard lock{mutex};
+            if (--busy == 0)
+            {
+                job_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex job_mutex;
+
+    // everything below is protected by `mutex`, except `current` (written before the job is posted
+    // and read-only while it runs) and `next_index`
+    std::mutex mutex;
+    std::condition_variable job_posted;
+    std::condition_variable job_done;
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    std::exception_ptr first_error;
+
+    job current;
+    std::atomic<size_t> next_index{0};
+};
+
+// Parallel consumption of a sequential range, like a generator of file paths or record batches.
+// Only one thread at a time advances the range, taking a batch of items into its own deque;
+// the workers process items from their deques, and when one runs out of them (and the range is busy or over)
+// it steals half of the items of another worker. So the producer's lock is taken once per batch,
+// and uneven items don't leave threads idle at the end.
+//
+// Use:
+//  parallel_for_each(pool, paths{dir}, [](std::string path) { process(path); });
+//  parallel_for_each_ordered(pool, records{file}, parse, [&](parsed p) { out.push_back(p); });
+//
+// Items are moved out of the range (`*std::move(it)`), so they should be cheap to move.
+namespace details
+{
+    template<typename RangeT>
+    class stealing_loop
+    {
+    public:
+        using iterator = decltype(std::declval<RangeT&>().begin());
+        using value_type = std::remove_cvref_t<decltype(*std::declval<iterator&>())>;
+
+        stealing_loop(RangeT& range, size_t workers, size_t batch)
+            : it_{range.begin()}, end_{range.end()}, queues_(workers), batch_{batch ? batch : 1}
+        {
+        }
+
+        // Calls `process(value, sequence)` for items till there're none left for this worker.
+        // After an exception (in any worker) the remaining items are skipped.
+        template<typename ProcessT>
+        void work(size_t self, ProcessT& process)
+        {
+            std::vector<item> taken;
+            try
+            {
+                while (!failed_.load(std::memory_order_relaxed))
+                {
+                    if (auto next = pop(self))
+                    {
+                        process(std::move(next->value), next->sequence);
+                        continue;
+                    }
+                    if (exhausted_.load(std::memory_order_acquire))
+                    {
+                        if (steal(self, taken))
+                        {
+                            continue;
+                        }
+                        return;
+                    }
+                    // somebody is advancing the range: better steal than wait for them
+                    std::unique_lock producer{producer_mutex_, std::try_to_lock};
+                    if (!producer)
+                    {
+                        if (steal(self, taken))
+                        {
+                            continue;
+                        }
+                        producer.lock();
+                    }
+                    pull(self, taken);
+                }
+            }
+            catch (...)
+            {
+                failed_.store(true, std::memory_order_relaxed);
+                throw;
+            }
+        }
+
+    private:
+        struct item
+        {
+            value_type value;
+            size_t sequence;
+        };
+
+        // a cache line each, so the workers don't slow each other down
+        struct alignas(64) queue
+        {
+            std::mutex mutex;
+            std::deque<item> items;
+        };
+
+        // the owner takes items from the front (in the range's order), thieves take them from the back
+        std::optional<item> pop(size_t self)
+        {
+            auto& own = queues_[self];
+            std::lock_guard lock{own.mutex};
+            if (own.items.empty())
+            {
+                return std::nullopt;
+            }
+            std::optional<item> front{std::move(own.items.front())};
+            own.items.pop_front();
+            return front;
+        }
+
+        // called with `producer_mutex_` locked; the range is advanced without holding the queue lock
+        void pull(size_t self, std::vector<item>& taken)
+        {
+            for (size_t i = 0; i < batch_ && it_ != end_; ++i, ++it_)
+            {
+                taken.push_back({*std::move(it_), next_sequence_++});
+            }
+            push(self, taken);
+            if (it_ == end_)
+            {
+                exhausted_.store(true, std::memory_order_release);
+            }
+        }
+
+        bool steal(size_t self, std::vector<item>& taken)
+        {
+            for (size_t i = 1; i < queues_.size() && taken.empty(); ++i)
+            {
+                auto& victim = queues_[(self + i) % queues_.size()];
+                std::lock_guard lock{victim.mutex};
+                auto count = (victim.items.size() + 1) / 2;
+                auto first = victim.items.end() - count;
+                taken.assign(std::make_move_iterator(first), std::make_move_iterator(victim.items.end()));
+                victim.items.erase(first, victim.items.end());
+            }
+            if (taken.empty())
+            {
+                return false;
+            }
+            push(self, taken);
+            return true;
+        }
+
+        void push(size_t self, std::vector<item>& taken)
+        {
+            auto& own = queues_[self];
+            std::lock_guard lock{own.mutex};
+            own.items.insert(own.items.end(), std::make_move_iterator(taken.begin()), std::make_move_iterator(taken.end()));
+            taken.clear();
+        }
+
+        std::mutex producer_mutex_;
+        iterator it_;       // these three are protected by `producer_mutex_`
+        decltype(std::declval<RangeT&>().end()) end_;
+        size_t next_sequence_ = 0;
+        std::atomic<bool> exhausted_{false};
+        std::atomic<bool> failed_{false};
+        std::vector<queue> queues_;
+        const size_t batch_;
+    };
+}
+
+// Calls `func(item)` for every item of `range` on the pool threads, in no particular order.
+template<typename RangeT, typename FuncT>
+void parallel_for_each(thread_pool& pool, RangeT&& range, FuncT&& func, size_t batch = 16)
+{
+    details::stealing_loop<std::remove_reference_t<RangeT>> loop{range, pool.size(), batch};
+    auto process = [&](auto&& value, size_t) { func(std::forward<decltype(value)>(value)); };
+    pool.for_each_index(pool.size(), [&](size_t worker) { loop.work(worker, process); });
+}
+
+// The same on a temporary pool.
+template<typename RangeT, typename FuncT>
+void parallel_for_each(RangeT&& range, FuncT&& func, size_t threads = std::thread::hardware_concurrency())
+{
+    thread_pool pool{threads};
+    parallel_for_each(pool, std::forward<RangeT>(range), std::forward<FuncT>(func));
+}
+
+// Calls `func(item)` in parallel, and `sink(result)` one at a time, in the order of the items.
+// Results that are ready early wait for the previous ones (so a slow item holds the later results in memory).
+template<typename RangeT, typename FuncT, typename SinkT>
+void parallel_for_each_ordered(thread_pool& pool, RangeT&& range, FuncT&& func, SinkT&& sink, size_t batch = 16)
+{
+    using loop_type = details::stealing_loop<std::remove_reference_t<RangeT>>;
+    using result_type = std::invoke_result_t<FuncT&, typename loop_type::value_type&&>;
+
+    loop_type loop{range, pool.size(), batch};
+    std::mutex mutex;
+    std::map<size_t, result_type> early;    // by sequence number
+    size_t next = 0;
+    auto process = [&](typename loop_type::value_type&& value, size_t sequence) {
+        auto result = func(std::move(value));
+        std::lock_guard lock{mutex};
+        if (sequence != next)
+        {
+            early.emplace(sequence, std::move(result));
+            return;
+        }
+        sink(std::move(result));
+        for (++next; !early.empty() && early.begin()->first == next; ++next)
+        {
+            sink(std::move(early.begin()->second));
+            early.erase(early.begin());
+        }
+    };
+    pool.for_each_index(pool.size(), [&](size_t worker) { loop.work(worker, process); });
+}
@@ -1,127 +1,205 @@
-// See [explanation](https://en.wikipedia.org/wiki/X_Macro).
-// There're two approaches to X-Macros:
+#include "x_macros.h"
 
-// a) define data itself as a macro accepting "functor" and expand it with different "functors".
+#include <cassert>
+#include <cstring>
+#include <vector>
 
-// clang-format off
-#define TOKEN_TYPES(val)\
-    val(' ', Whitespace,"%255[ \t\r\n]%n")\
-    val('(', ParenLeft, "%1[(]%n")\
-    val(')', ParenRight,"%1[)]%n")\
-    val(',', Comma,     "%1[,]%n")\
-    val('=', Assign,    "%1[=]%n")\
-    val('+', Plus,      "%[+]%n")\
-    val('-', Minus,     "%1[-]%n")\
-    val('*', Asterisk,  "%1[*]%n")\
-    val('/', Slash,     "%1[/]%n")\
-    val('^', Caret,     "%1[\\^]%n")\
-    val('~', Tilde,     "%1[~]%n")\
-    val('!', Bang,      "%1[!]%n")\
-    val('?', Question,  "%1[?]%n")\
-    val(':', Colon,     "%1[:]%n")\
-    val('\0', Name,     "%255[a-zA-Z_]%n")\
-    val('\0', Number,   "%255[0-9]%n")\
-    val('\0', Eof,      nullptr)
-// clang-format on
+#if __has_include(<sys/mman.h>)
+#include "handle_wrapper.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// Generate `enum` itself
-#define ENUM_VAL(_, V, ...) V,
-enum class TokType : int
+// Lexing a memory-mapped file: the whole file is never copied, tokens point right into the mapping.
+size_t count_tokens_in_file(const char *path)
 {
-    TOKEN_TYPES(ENUM_VAL)
-        _Count,
-};
-constexpr size_t TokType_Count = (size_t)TokType::_Count;
-#undef ENUM_VAL
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    auto close_file = scope_guard{[=] { close(fd); }};
+    struct stat st;
+    fstat(fd, &st);
+    auto size = static_cast<size_t>(st.st_size);
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(data != MAP_FAILED);
+    auto unmap = scope_guard{[=] { munmap(data, size); }};
 
-// generate strings (e.g. for debug output)
-#define ENUM_STR(S, _, ...) S,
-constexpr char TokType_Chars[TokType_Count] = {
-    TOKEN_TYPES(ENUM_STR)};
-#undef ENUM_STR
+    size_t count = 0;
+    LexerView lexer{std::string_view{static_cast<const char *>(data), size}};
+    for (auto token = lexer.next(); token.type != TokType::Eof; token = lexer.next())
+    {
+        ++count;
+    }
+    return count;
+}
+#endif
 
-// generate an array of patterns to be used by tokenizer
-#define TOKEN_PATTERN(N, V, P) P,
-constexpr const char *const TokPatterns[TokType_Count] = {
-    TOKEN_TYPES(TOKEN_PATTERN)};
-#undef TOKEN_PATTERN
+int main()
+{
+    Lexer lexer{"x = (alpha + 42) * beta_2"};
+    std::vector<Token> tokens;
+    for (auto token = lexer.next(); token.type != TokType::Eof; token = lexer.next())
+    {
+        std::printf("%c %s\n", TokType_Chars[(int)token.type] ? TokType_Chars[(int)token.type] : '_', token.text.c_str());
+        tokens.push_back(token);
+    }
+    const TokType expected[] = {
+        TokType::Name, TokType::Assign, TokType::ParenLeft, TokType::Name, TokType::Plus, TokType::Number,
+        TokType::ParenRight, TokType::Asterisk, TokType::Name, TokType::Number};
+    assert(tokens.size() == std::size(expected));
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        assert(tokens[i].type == expected[i]);
+    }
+    assert(tokens[3].text == "alpha" && tokens[5].text == "42" && tokens[8].text == "beta_");
 
-/* b) put data in separate file and include it multiple times
- Something like:
- file: tokens.inc
- ```
-    // note lack of include-guard
-    // with a separate file one doesn't need to put `\` at the end of line
-    val(' ', Whitespace, %255[ \t\r\n]%n")
-    val('(', ParenLeft, "%1[(]%n")
-    val(')', ParenRight,"%1[)]%n")
-    val(',', Comma,     "%1[,]%n")
-    val('=', Assign,    "%1[=]%n")
-    val('+', Plus,      "%[+]%n")
-    val('-', Minus,     "%1[-]%n")
-    val('*', Asterisk,  "%1[*]%n")
-    val('/', Slash,     "%1[/]%n")
-    val('^', Caret,     "%1[\\^]%n")
-    val('~', Tilde,     "%1[~]%n")
-    val('!', Bang,      "%1[!]%n")
-    val('?', Question,  "%1[?]%n")
-    val(':', Colon,     "%1[:]%n")
-    val('\0', Name,     "%255[a-zA-Z_]%n")
-    val('\0', Number,   "%255[0-9]%n")
-    val('\0', Eof,      NULL)
-```
-file: tokens.cpp
-```
-// Generate `enum` itself
-#define ENUM_VAL(_, V, ...) V,
-#include "tokens.inc"
-#undef ENUM_VAL
-// etc.
-```
-*/
+    // the table-driven lexer produces exactly the same tokens as the `sscanf` one
+    // (up to the first byte nothing matches: `ScanfLexer` stops there, `Lexer` makes an `Invalid` token)
+    const char* inputs[] = {
+        "x = (alpha + 42) * beta_2",
+        "a+++b--c^\\d ~e!f?g:h, i/j\t\r\n  (0123456789)",
+        "name @ rest",
+    };
+    for (auto input : inputs)
+    {
+        Lexer lexer{input};
+        ScanfLexer scanf_lexer{input};
+        for (;;)
+        {
+            auto token = lexer.next();
+            auto expected = scanf_lexer.next();
+            if (expected.type == TokType::Eof && token.type == TokType::Invalid)
+            {
+                break;
+            }
+            assert(token.type == expected.type && token.text == expected.text);
+            if (token.type == TokType::Eof)
+            {
+                break;
+            }
+        }
+    }
 
-// Example of use:
-#include <string>
+    // error recovery: bad bytes don't end the stream
+    {
+        LexerView lexer{"name @. rest $"};
+        assert(lexer.next().text == "name");
+        auto invalid = lexer.next();
+        assert(invalid.type == TokType::Invalid && invalid.text == "@.");
+        assert(lexer.next().text == "rest");
+        assert(lexer.next().type == TokType::Invalid);
+        assert(lexer.next().type == TokType::Eof);
+    }
+    // widths are respected too: names are split every 255 chars
+    Lexer long_name{std::string(300, 'a')};
+    assert(long_name.next().text.size() == 255 && long_name.next().text.size() == 45);
 
-struct Token
-{
-    TokType type;
-    std::string text;
-};
+    // zero-copy: tokens point into the source
+    const std::string source = "sum = a+b";
+    LexerView view{source};
+    auto first = view.next();
+    assert(first.type == TokType::Name && first.text == "sum" && first.text.data() == source.data());
+    assert(view.next().type == TokType::Assign);
+    assert(view.next().text.data() == source.data() + 6);
 
-struct Lexer
-{
-    Lexer(std::string &&s)
-        : contents{s}, it{s.begin()}
+    // batch: the same tokens as `LexerView`, as parallel arrays
+    TokenBuffer buffer;
+    for (auto input : inputs)
     {
+        tokenize_all(input, buffer);
+        LexerView lexer{input};
+        for (size_t i = 0; i < buffer.size(); ++i)
+        {
+            auto token = lexer.next();
+            assert(buffer.types()[i] == token.type && buffer.text(i, input) == token.text);
+        }
+        assert(lexer.next().type == TokType::Eof);
     }
+    tokenize_all(std::string(300, 'a'), buffer);
+    assert(buffer.size() == 2 && buffer.lengths()[1] == 45);
 
-    Token next()
+    // streaming: any chunking gives the same tokens
     {
-        for (auto i = 0u; it != contents.end() && i < TokType_Count; ++i)
+        const std::string_view input = "x = (alpha + 42) * beta_2  \t over_chunks\n @@@ #";
+        TokenBuffer expected;
+        tokenize_all(input, expected);
+        for (size_t chunk_size = 1; chunk_size <= input.size(); ++chunk_size)
         {
-
-            int bytes_read = 0;
-            char buf[256] = {0};
-            auto pattern = TokPatterns[i];
-            if (!pattern)
-                continue;
-            // using sscanf as a "poor man's regex engine"
-            if (std::sscanf(&*it, pattern, buf, &bytes_read))
+            ChunkedLexer chunked;
+            TokenBuffer tokens;
+            for (size_t i = 0; i < input.size(); i += chunk_size)
             {
-                it += bytes_read;
-                if ((TokType)i == TokType::Whitespace)
-                {
-                    continue;
-                }
-                auto token = Token{(TokType)i, buf};
-                return token;
+                chunked.feed(input.substr(i, chunk_size), tokens);
             }
+            chunked.finish(tokens);
+            assert(tokens == expected);
+        }
+        assert(expected.types().back() == TokType::Invalid && expected.lengths().back() == 1);
+    }
+
+    // positions
+    {
+        const std::string_view input = "a = 1\n\nb = @\r\n  c";
+        SourceLines lines{input};
+        LexerView lexer{input};
+        auto a = lexer.next();
+        auto position = lines.position(a);
+        assert(position.line == 1 && position.column == 1);
+        lexer.next();
+        lexer.next();
+        auto b = lexer.next();
+        position = lines.position(b);
+        assert(position.line == 3 && position.column == 1);
+        lexer.next();
+        auto invalid = lexer.next();
+        assert(invalid.type == TokType::Invalid);
+        position = lines.position(invalid);
+        assert(position.line == 3 && position.column == 5);
+        position = lines.position(lexer.next());
+        assert(position.line == 4 && position.column == 3);
+        // earlier offsets after the index is built
+        position = lines.position(2);
+        assert(position.line == 1 && position.column == 3);
+        position = lines.position(6);
+        assert(position.line == 2 && position.column == 1);
+    }
+
+    // parallel: the same tokens, whatever the chunks are
+    {
+        std::string input;
+        for (int i = 0; i < 2000; ++i)
+        {
+            input += "x" + std::to_string(i) + " = (alpha + " + std::to_string(i * 42) + ") @ beta_\n\t  ";
+        }
+        input += std::string(1000, 'a') + " " + std::string(2000, ' ') + "tail";
+        TokenBuffer expected;
+        tokenize_all(input, expected);
+
+        thread_pool pool{4};
+        TokenBuffer tokens;
+        for (size_t min_chunk_size : {1, 7, 100, 4096, 1 << 20})
+        {
+            ParallelLexer lexer{pool, min_chunk_size};
+            lexer.tokenize(input, tokens);
+            assert(tokens == expected);
+            // buffers are reused
+            lexer.tokenize(input, tokens);
+            assert(tokens == expected);
         }
-        return Token{TokType::Eof, ""};
     }
 
-private:
-    std::string contents;
-    std::string::iterator it;
-};
\ No newline at end of file
+#if __has_include(<sys/mman.h>)
+    {
+        char path[] = "/tmp/x_macros_XXXXXX";
+        int fd = mkstemp(path);
+        const std::string contents = "x = (alpha + 42) * beta_2\n";
+        for (int i = 0; i < 1000; ++i)
+        {
+            write(fd, contents.data(), contents.size());
+        }
+        close(fd);
+        assert(count_tokens_in_file(path) == 10'000);
+        unlink(path);
+    }
+#endif
+}
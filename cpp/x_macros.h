@@ -0,0 +1,666 @@
+#pragma once
+
+// See [explanation](https://en.wikipedia.org/wiki/X_Macro).
+// There're two approaches to X-Macros:
+
+// a) define data itself as a macro accepting "functor" and expand it with different "functors".
+
+#include <cstddef>
+
+// clang-format off
+#define TOKEN_TYPES(val)\
+    val(' ', Whitespace,"%255[ \t\r\n]%n")\
+    val('(', ParenLeft, "%1[(]%n")\
+    val(')', ParenRight,"%1[)]%n")\
+    val(',', Comma,     "%1[,]%n")\
+    val('=', Assign,    "%1[=]%n")\
+    val('+', Plus,      "%[+]%n")\
+    val('-', Minus,     "%1[-]%n")\
+    val('*', Asterisk,  "%1[*]%n")\
+    val('/', Slash,     "%1[/]%n")\
+    val('^', Caret,     "%1[\\^]%n")\
+    val('~', Tilde,     "%1[~]%n")\
+    val('!', Bang,      "%1[!]%n")\
+    val('?', Question,  "%1[?]%n")\
+    val(':', Colon,     "%1[:]%n")\
+    val('\0', Name,     "%255[a-zA-Z_]%n")\
+    val('\0', Number,   "%255[0-9]%n")\
+    val('\0', Invalid,  nullptr)\
+    val('\0', Eof,      nullptr)
+// clang-format on
+
+// Generate `enum` itself
+#define ENUM_VAL(_, V, ...) V,
+enum class TokType : int
+{
+    TOKEN_TYPES(ENUM_VAL)
+        _Count,
+};
+constexpr size_t TokType_Count = (size_t)TokType::_Count;
+#undef ENUM_VAL
+
+// generate strings (e.g. for debug output)
+#define ENUM_STR(S, _, ...) S,
+constexpr char TokType_Chars[TokType_Count] = {
+    TOKEN_TYPES(ENUM_STR)};
+#undef ENUM_STR
+
+// generate an array of patterns to be used by tokenizer
+#define TOKEN_PATTERN(N, V, P) P,
+constexpr const char *const TokPatterns[TokType_Count] = {
+    TOKEN_TYPES(TOKEN_PATTERN)};
+#undef TOKEN_PATTERN
+
+/* b) put data in separate file and include it multiple times
+ Something like:
+ file: tokens.inc
+ ```
+    // note lack of include-guard
+    // with a separate file one doesn't need to put `\` at the end of line
+    val(' ', Whitespace, %255[ \t\r\n]%n")
+    val('(', ParenLeft, "%1[(]%n")
+    val(')', ParenRight,"%1[)]%n")
+    val(',', Comma,     "%1[,]%n")
+    val('=', Assign,    "%1[=]%n")
+    val('+', Plus,      "%[+]%n")
+    val('-', Minus,     "%1[-]%n")
+    val('*', Asterisk,  "%1[*]%n")
+    val('/', Slash,     "%1[/]%n")
+    val('^', Caret,     "%1[\\^]%n")
+    val('~', Tilde,     "%1[~]%n")
+    val('!', Bang,      "%1[!]%n")
+    val('?', Question,  "%1[?]%n")
+    val(':', Colon,     "%1[:]%n")
+    val('\0', Name,     "%255[a-zA-Z_]%n")
+    val('\0', Number,   "%255[0-9]%n")
+    val('\0', Invalid,  NULL)
+    val('\0', Eof,      NULL)
+```
+file: tokens.cpp
+```
+// Generate `enum` itself
+#define ENUM_VAL(_, V, ...) V,
+#include "tokens.inc"
+#undef ENUM_VAL
+// etc.
+```
+*/
+
+// Example of use:
+#include <cstdio>
+#include <string>
+
+struct Token
+{
+    TokType type;
+    std::string text;
+};
+
+// the first version: tries each pattern with `sscanf`
+struct ScanfLexer
+{
+    ScanfLexer(std::string &&s)
+        : contents{s}, it{contents.begin()}
+    {
+    }
+
+    Token next()
+    {
+        for (auto i = 0u; it != contents.end() && i < TokType_Count; ++i)
+        {
+
+            int bytes_read = 0;
+            char buf[256] = {0};
+            auto pattern = TokPatterns[i];
+            if (!pattern)
+                continue;
+            // using sscanf as a "poor man's regex engine"
+            if (std::sscanf(&*it, pattern, buf, &bytes_read))
+            {
+                it += bytes_read;
+                if ((TokType)i == TokType::Whitespace)
+                {
+                    continue;
+                }
+                auto token = Token{(TokType)i, buf};
+                return token;
+            }
+        }
+        return Token{TokType::Eof, ""};
+    }
+
+private:
+    std::string contents;
+    std::string::iterator it;
+};
+
+// The second version uses the same patterns, but instead of interpreting them with `sscanf`
+// for every token, we "compile" them (at compile time!) into lookup tables:
+// - which token type starts with a given byte (the first pattern that accepts it wins, as with `sscanf` loop);
+// - for every byte, a bitmask of token types which can continue with it;
+// - max length of every token type (from the width in the pattern).
+// Bytes no pattern accepts make `Invalid` tokens (a run of such bytes is one token), so that the bad input is
+// reported and skipped instead of ending the stream (as `ScanfLexer` does). It's just more table entries,
+// the loop doesn't change.
+// So every token is recognized in one pass over its bytes.
+//
+// Only the kind of patterns used in `TOKEN_TYPES` is supported: `%<width>[<set>]%n`
+// (`<set>` can have ranges, `^` for negation and `]` as the first char, as in `scanf`).
+#include <cstdint>
+
+namespace lexer_tables
+{
+    struct pattern_info
+    {
+        bool valid = false;
+        bool accepts[256] = {};
+        size_t max_length = SIZE_MAX;
+    };
+
+    constexpr pattern_info parse_pattern(const char *p)
+    {
+        pattern_info result;
+        if (!p || *p++ != '%')
+        {
+            return result;
+        }
+        if ('0' <= *p && *p <= '9')
+        {
+            result.max_length = 0;
+            for (; '0' <= *p && *p <= '9'; ++p)
+            {
+                result.max_length = result.max_length * 10 + (*p - '0');
+            }
+        }
+        if (*p++ != '[')
+        {
+            return result;
+        }
+        bool negate = *p == '^';
+        if (negate)
+        {
+            ++p;
+        }
+        bool set[256] = {};
+        // `]` right after `[` (or `[^`) is a part of the set
+        for (bool first = true; *p && (first || *p != ']'); ++p, first = false)
+        {
+            auto from = static_cast<unsigned char>(*p);
+            auto to = from;
+            if (p[1] == '-' && p[2] && p[2] != ']')
+            {
+                to = static_cast<unsigned char>(p[2]);
+                p += 2;
+            }
+            for (unsigned c = from; c <= to; ++c)
+            {
+                set[c] = true;
+            }
+        }
+        if (*p != ']')
+        {
+            return result;
+        }
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            // `sscanf` stops at '\0' anyway
+            result.accepts[c] = c != 0 && set[c] != negate;
+        }
+        result.valid = true;
+        return result;
+    }
+
+    static_assert(TokType_Count <= 32, "token types don't fit into `uint32_t` mask");
+
+    struct dfa
+    {
+        TokType start[256];
+        uint32_t continues[256];
+        size_t max_length[TokType_Count];
+    };
+
+    constexpr dfa make_dfa()
+    {
+        dfa result{};
+        for (auto &type : result.start)
+        {
+            type = TokType::Invalid;
+        }
+        // going backwards, so that earlier patterns win
+        for (auto i = TokType_Count; i-- > 0;)
+        {
+            auto pattern = parse_pattern(TokPatterns[i]);
+            if (!pattern.valid)
+            {
+                continue;
+            }
+            result.max_length[i] = pattern.max_length;
+            for (unsigned c = 0; c < 256; ++c)
+            {
+                if (pattern.accepts[c])
+                {
+                    result.start[c] = static_cast<TokType>(i);
+                    result.continues[c] |= 1u << i;
+                }
+            }
+        }
+        result.max_length[static_cast<int>(TokType::Invalid)] = SIZE_MAX;
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            if (result.start[c] == TokType::Invalid)
+            {
+                result.continues[c] |= 1u << static_cast<int>(TokType::Invalid);
+            }
+        }
+        return result;
+    }
+
+    inline constexpr dfa TokDfa = make_dfa();
+
+    // Extends a token of `type` which is `length` chars long so far; returns where it ends.
+    inline const char *continue_token(TokType type, size_t &length, const char *it, const char *end)
+    {
+        const auto mask = 1u << static_cast<int>(type);
+        const auto max_length = TokDfa.max_length[static_cast<int>(type)];
+        for (; it != end && length < max_length && (TokDfa.continues[static_cast<unsigned char>(*it)] & mask); ++it)
+        {
+            ++length;
+        }
+        return it;
+    }
+}
+
+// Zero-copy version: tokens are views into the source, which is owned by the caller
+// (e.g. a `std::string` or a memory-mapped file), so lexing doesn't allocate or copy anything.
+#include <string_view>
+
+struct TokenView
+{
+    TokType type;
+    std::string_view text;
+};
+
+struct LexerView
+{
+    explicit LexerView(std::string_view source)
+        : source{source}, it{source.data()}
+    {
+    }
+    explicit LexerView(const char *source)
+        : LexerView{std::string_view{source}}
+    {
+    }
+    // preventing call with a temporary string: tokens would point to the freed memory
+    LexerView(std::string &&s) = delete;
+
+    TokenView next()
+    {
+        using lexer_tables::TokDfa;
+        const auto end = source.data() + source.size();
+        while (it != end)
+        {
+            auto begin = it;
+            auto type = TokDfa.start[static_cast<unsigned char>(*it)];
+            size_t length = 1;
+            it = lexer_tables::continue_token(type, length, it + 1, end);
+            if (type != TokType::Whitespace)
+            {
+                return TokenView{type, {begin, length}};
+            }
+        }
+        return TokenView{TokType::Eof, {it, 0}};
+    }
+
+private:
+    std::string_view source;
+    const char *it;
+};
+
+// Owns the source and returns tokens with their own copy of the text.
+// Not copyable or movable: `view` points into `contents`.
+struct Lexer
+{
+    Lexer(std::string &&s)
+        : contents{std::move(s)}, view{contents}
+    {
+    }
+    Lexer(const Lexer &) = delete;
+    Lexer &operator=(const Lexer &) = delete;
+
+    Token next()
+    {
+        auto token = view.next();
+        return Token{token.type, std::string{token.text}};
+    }
+
+private:
+    std::string contents;
+    LexerView view;
+};
+
+// Batch version: the whole input at once, into a "structure of arrays" instead of one `next()` call per token.
+// The parser then walks three dense arrays, and the buffer is reused between calls, so there're no allocations
+// once it's big enough.
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <vector>
+
+class TokenBuffer
+{
+public:
+    size_t size() const { return count; }
+    void clear() { count = 0; }
+
+    std::span<const TokType> types() const { return {types_.get(), count}; }
+    // from the beginning of the input (the whole stream for `ChunkedLexer`)
+    std::span<const size_t> offsets() const { return {offsets_.get(), count}; }
+    std::span<const uint32_t> lengths() const { return {lengths_.get(), count}; }
+
+    std::string_view text(size_t i, std::string_view source) const
+    {
+        return source.substr(offsets_[i], lengths_[i]);
+    }
+
+    // Writing: `reserve` room for at most `n` more tokens, write them through the returned pointers,
+    // then `commit` how many were written. Why not `push_back`? It checks the capacity of every array
+    // for every token, and the compiler has to reload the pointers after every store, which makes
+    // filling the three arrays noticeably slower.
+    struct slots
+    {
+        TokType *types;
+        size_t *offsets;
+        uint32_t *lengths;
+    };
+
+    // The arrays are left uninitialized (unlike `std::vector::resize`), so reserving more than is written is cheap,
+    // but it's still memory: reserve what's needed for a block of tokens, not for a whole file.
+    slots reserve(size_t n)
+    {
+        // the arrays are only ever grown (never shrunk by `clear`), so it's the only place they're touched
+        if (capacity < count + n)
+        {
+            capacity = std::max(count + n, 2 * capacity);
+            grow(types_);
+            grow(offsets_);
+            grow(lengths_);
+        }
+        return {types_.get() + count, offsets_.get() + count, lengths_.get() + count};
+    }
+
+    void commit(size_t n) { count += n; }
+
+    void push_back(TokType type, size_t offset, size_t length)
+    {
+        auto slot = reserve(1);
+        *slot.types = type;
+        *slot.offsets = offset;
+        *slot.lengths = static_cast<uint32_t>(length);
+        commit(1);
+    }
+
+    friend bool operator==(const TokenBuffer &a, const TokenBuffer &b)
+    {
+        return std::ranges::equal(a.types(), b.types()) && std::ranges::equal(a.offsets(), b.offsets())
+               && std::ranges::equal(a.lengths(), b.lengths());
+    }
+
+private:
+    template <typename T>
+    void grow(std::unique_ptr<T[]> &array)
+    {
+        auto grown = std::make_unique_for_overwrite<T[]>(capacity);
+        std::copy_n(array.get(), count, grown.get());
+        array = std::move(grown);
+    }
+
+    std::unique_ptr<TokType[]> types_;
+    std::unique_ptr<size_t[]> offsets_;
+    std::unique_ptr<uint32_t[]> lengths_;
+    size_t capacity = 0;
+    size_t count = 0;
+};
+
+namespace lexer_tables
+{
+    // a token which may continue in the next chunk
+    struct partial_token
+    {
+        TokType type = TokType::Eof;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    inline void flush(partial_token &partial, TokenBuffer &out)
+    {
+        if (partial.type != TokType::Eof && partial.type != TokType::Whitespace)
+        {
+            out.push_back(partial.type, partial.offset, partial.length);
+        }
+        partial = {};
+    }
+
+    // Lexes [begin, end) (`base` is the offset of `begin` in the stream), starting with `partial` if any.
+    // The last token is left in `partial` if it can continue after `end`.
+    inline void tokenize_range(const char *begin, const char *end, size_t base, partial_token &partial,
+                                      TokenBuffer &out)
+    {
+        auto it = begin;
+        if (partial.type != TokType::Eof)
+        {
+            it = continue_token(partial.type, partial.length, it, end);
+            if (it == end && partial.length < TokDfa.max_length[static_cast<int>(partial.type)])
+            {
+                return;
+            }
+            flush(partial, out);
+        }
+        // Every token is at least one byte long, so a block of bytes never has more tokens than bytes;
+        // blocks keep the buffer proportional to the number of tokens rather than to the input size.
+        constexpr size_t block_size = 4096;
+        auto slots = out.reserve(std::min<size_t>(end - it, block_size));
+        size_t n = 0;
+        for (auto block_end = it + std::min<size_t>(end - it, block_size); it != end;)
+        {
+            if (it >= block_end)
+            {
+                out.commit(n);
+                slots = out.reserve(std::min<size_t>(end - it, block_size));
+                n = 0;
+                block_end = it + std::min<size_t>(end - it, block_size);
+            }
+            auto token_begin = it;
+            auto type = TokDfa.start[static_cast<unsigned char>(*it)];
+            size_t length = 1;
+            it = continue_token(type, length, it + 1, end);
+            if (it == end && length < TokDfa.max_length[static_cast<int>(type)])
+            {
+                partial = {type, base + (token_begin - begin), length};
+                break;
+            }
+            if (type != TokType::Whitespace)
+            {
+                slots.types[n] = type;
+                slots.offsets[n] = base + (token_begin - begin);
+                slots.lengths[n] = static_cast<uint32_t>(length);
+                ++n;
+            }
+        }
+        out.commit(n);
+    }
+}
+
+// Replaces the contents of `out` with all the tokens of `source`.
+inline void tokenize_all(std::string_view source, TokenBuffer &out)
+{
+    out.clear();
+    lexer_tables::partial_token partial;
+    lexer_tables::tokenize_range(source.data(), source.data() + source.size(), 0, partial, out);
+    lexer_tables::flush(partial, out);
+}
+
+// Streaming version, for the input which comes in chunks (e.g. `read` into a fixed buffer):
+// a token cut by the chunk boundary is carried over and emitted once it's complete.
+// Only its type and length are carried, not the text, so the chunks aren't copied anywhere;
+// offsets are from the beginning of the stream, so it's up to the caller to keep the text it needs.
+struct ChunkedLexer
+{
+    // appends complete tokens of `chunk` to `out`
+    void feed(std::string_view chunk, TokenBuffer &out)
+    {
+        lexer_tables::tokenize_range(chunk.data(), chunk.data() + chunk.size(), consumed, partial, out);
+        consumed += chunk.size();
+    }
+
+    // the end of the stream: emits the carried token, if any
+    void finish(TokenBuffer &out)
+    {
+        lexer_tables::flush(partial, out);
+    }
+
+    // bytes lexed so far
+    size_t offset() const { return consumed; }
+
+private:
+    lexer_tables::partial_token partial;
+    size_t consumed = 0;
+};
+
+// Parallel version for big inputs: the input is cut into chunks at whitespace (no token contains whitespace,
+// so chunks are lexed exactly as they would be as part of the whole input), chunks are lexed on a thread pool,
+// and their tokens are copied into the output in order (in parallel too: chunk sizes are known by then).
+// Keep the `ParallelLexer` around to reuse the per-chunk buffers.
+#include "thread_pool.h"
+
+struct ParallelLexer
+{
+    explicit ParallelLexer(thread_pool &pool, size_t min_chunk_size = 256 * 1024)
+        : pool{pool}, min_chunk_size{min_chunk_size}
+    {
+    }
+
+    void tokenize(std::string_view source, TokenBuffer &out)
+    {
+        // a few chunks per thread to even out the load
+        auto chunk_count = std::max<size_t>(1, std::min(source.size() / min_chunk_size, 4 * pool.size()));
+        if (chunk_count == 1)
+        {
+            tokenize_all(source, out);
+            return;
+        }
+        split(source, chunk_count);
+        chunks.resize(bounds.size() - 1);
+
+        pool.for_each_index(chunks.size(), [&](size_t i) {
+            auto &chunk = chunks[i];
+            chunk.clear();
+            lexer_tables::partial_token partial;
+            lexer_tables::tokenize_range(source.data() + bounds[i], source.data() + bounds[i + 1], bounds[i], partial,
+                                         chunk);
+            lexer_tables::flush(partial, chunk);
+        });
+
+        // stitching
+        first_token.resize(chunks.size() + 1);
+        first_token[0] = 0;
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            first_token[i + 1] = first_token[i] + chunks[i].size();
+        }
+        out.clear();
+        auto slots = out.reserve(first_token.back());
+        pool.for_each_index(chunks.size(), [&](size_t i) {
+            auto &chunk = chunks[i];
+            auto first = first_token[i];
+            std::copy(chunk.types().begin(), chunk.types().end(), slots.types + first);
+            std::copy(chunk.offsets().begin(), chunk.offsets().end(), slots.offsets + first);
+            std::copy(chunk.lengths().begin(), chunk.lengths().end(), slots.lengths + first);
+        });
+        out.commit(first_token.back());
+    }
+
+private:
+    // chunk boundaries (with 0 and `source.size()`): every one is moved forward to the next whitespace
+    void split(std::string_view source, size_t chunk_count)
+    {
+        bounds.clear();
+        bounds.push_back(0);
+        for (size_t i = 1; i < chunk_count; ++i)
+        {
+            auto bound = std::max(source.size() / chunk_count * i, bounds.back());
+            while (bound < source.size()
+                   && lexer_tables::TokDfa.start[static_cast<unsigned char>(source[bound])] != TokType::Whitespace)
+            {
+                ++bound;
+            }
+            if (bound != bounds.back() && bound != source.size())
+            {
+                bounds.push_back(bound);
+            }
+        }
+        bounds.push_back(source.size());
+    }
+
+    thread_pool &pool;
+    size_t min_chunk_size;
+    std::vector<size_t> bounds;
+    std::vector<TokenBuffer> chunks;
+    std::vector<size_t> first_token;
+};
+
+// Line/column of a token, for error messages. Nothing is counted while lexing (that would slow down every token
+// for the sake of a few errors): tokens only have offsets, and lines are found when a position is asked for.
+// Line starts are found with `memchr` (vectorized in any decent libc), only as far as the requested offset,
+// and are remembered, so the whole source is scanned at most once.
+#include <cstring>
+
+struct SourcePosition
+{
+    // both start from 1; column is in bytes
+    size_t line;
+    size_t column;
+};
+
+class SourceLines
+{
+public:
+    explicit SourceLines(std::string_view source)
+        : source{source}
+    {
+    }
+    SourceLines(std::string &&s) = delete;
+
+    SourcePosition position(size_t offset)
+    {
+        index_until(offset);
+        // the last line start at or before `offset`
+        auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+        return {static_cast<size_t>(line), offset - line_starts[line - 1] + 1};
+    }
+
+    SourcePosition position(const TokenView &token)
+    {
+        return position(token.text.data() - source.data());
+    }
+
+private:
+    void index_until(size_t offset)
+    {
+        while (indexed <= offset && indexed < source.size())
+        {
+            auto newline = static_cast<const char *>(std::memchr(source.data() + indexed, '\n', source.size() - indexed));
+            if (!newline)
+            {
+                indexed = source.size();
+                break;
+            }
+            indexed = newline - source.data() + 1;
+            line_starts.push_back(indexed);
+        }
+    }
+
+    std::string_view source;
+    std::vector<size_t> line_starts{0};
+    // everything before is indexed
+    size_t indexed = 0;
+};